@@ -0,0 +1,485 @@
+/*
+ * gentrace.c - Generate synthetic malloc lab traces from parametric models.
+ *
+ *     gcc -O2 -o gentrace gentrace.c -lm
+ *
+ *     gentrace [-n ops] [-l maxlive] [-s seed] [-z sizes] [-L lifetimes]
+ *              [-r chains] [-c handoff] [-p profile] [-b bytes] [-S sites]
+ *              [-o file]
+ *
+ * Output is the format mmeval and the lab driver read: four header numbers
+ * followed by one "a id size", "r id size" or "f id" line per operation.
+ * With -S an allocation also names the call site it came from, "a id size
+ * site", as a trace recorded from a real program would.
+ * Exactly -n operations are written and every block is freed by the end.
+ * Ids are recycled, so the header's id count is -l, the most blocks ever
+ * live at once. Memory use depends only on -l, never on -n, so traces of
+ * billions of operations are streamed straight to the file. The same seed
+ * and options always give the same trace.
+ *
+ * Models, given as comma separated parameters:
+ *
+ *   -z uniform,lo,hi           sizes evenly spread over [lo, hi]
+ *   -z power,alpha,min,max     Pareto sizes, most small, heavy tail
+ *   -z bimodal,small,large,p   fraction p around small, the rest around large
+ *
+ *   -L exp,mean                lifetimes exponential with mean ops
+ *   -L phase,len,f,mean        program runs in phases of len ops; fraction f
+ *                              of blocks die when their phase ends, the rest
+ *                              live an exponential mean ops
+ *
+ *   -r p,steps,growth          fraction p of blocks start a realloc chain of
+ *                              up to steps reallocs, each growing the block
+ *                              by the factor growth
+ *   -c p,batch                 fraction p of blocks are handed to a consumer
+ *                              that frees them oldest first in bursts of batch
+ *
+ *   -p ramp|peak|plateau       shape of the live bytes over the trace, up to
+ *                              -b bytes; frees are forced while above it
+ *
+ *   -S sites                   allocations come from this many call sites,
+ *                              each site standing for one band of lifetimes
+ *                              on a log scale; one in ten is from a random
+ *                              site instead, as a program's sites are never
+ *                              quite that consistent
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+typedef unsigned long long u64;
+
+enum { SIZE_UNIFORM, SIZE_POWER, SIZE_BIMODAL };
+enum { LIFE_EXP, LIFE_PHASE };
+enum { PROF_NONE, PROF_RAMP, PROF_PEAK, PROF_PLATEAU };
+
+/* options */
+static u64 nops = 100000;
+static int maxlive = 10000;
+static u64 seed = 1;
+static int size_model = SIZE_POWER;
+static double size_arg[3] = { 1.5, 16, 65536 };
+static int life_model = LIFE_EXP;
+static double life_arg[3] = { 1000 };
+static double chain_p, chain_growth = 1.5;
+static int chain_steps = 4;
+static double handoff_p;
+static int handoff_batch = 64;
+static int profile = PROF_NONE;
+static u64 maxbytes = 16 << 20;
+static int nsites;
+
+/* per id state */
+struct block {
+    u64 size;           /* current requested size */
+    int steps;          /* reallocs left in its chain */
+    int chainpos;       /* index in chains, -1: not in a chain */
+};
+
+/* pending free, ordered by death */
+struct death {
+    u64 when;           /* operation count at which it is freed */
+    int id;
+};
+
+static struct block *blocks;
+static int *freeids, nfreeids;      /* ids not in use */
+static struct death *deaths;        /* binary min-heap on when */
+static int ndeaths;
+static int *fifo, fifo_head, fifo_len;  /* blocks handed to the consumer */
+static int draining;                /* consumer frees left in this burst */
+static int *chains, nchains;        /* blocks with reallocs left */
+static int live;
+static u64 livebytes;
+
+static char outbuf[1 << 16];
+static size_t outlen;
+static FILE *out;
+
+/*
+ * rnd - Next number from a splitmix64 generator
+ */
+static u64 rnd(void)
+{
+    u64 z = ( seed += 0x9e3779b97f4a7c15ULL );
+
+    z = ( z ^ ( z >> 30 ) ) * 0xbf58476d1ce4e5b9ULL;
+    z = ( z ^ ( z >> 27 ) ) * 0x94d049bb133111ebULL;
+    return z ^ ( z >> 31 );
+}
+
+/*
+ * unif - Uniform double in (0, 1]
+ */
+static double unif(void)
+{
+    return ( ( rnd() >> 11 ) + 1 ) * ( 1.0 / 9007199254740992.0 );
+}
+
+/*
+ * pick_size - Requested size for a new block
+ */
+static u64 pick_size(void)
+{
+    double s;
+
+    switch( size_model ) {
+    case SIZE_UNIFORM:
+        s = size_arg[0] + ( size_arg[1] - size_arg[0] + 1 ) * ( 1 - unif() );
+        break;
+    case SIZE_POWER:
+        s = size_arg[1] / pow( unif(), 1 / size_arg[0] );
+        if( s > size_arg[2] )
+            s = size_arg[2];
+        break;
+    default:
+        s = unif() <= size_arg[2] ? size_arg[0] : size_arg[1];
+        s *= 0.5 + unif();  /* spread each mode over [s/2, 3s/2] */
+        break;
+    }
+    return s < 1 ? 1 : (u64)s;
+}
+
+/*
+ * pick_death - Operation count at which a block made at now is freed
+ */
+static u64 pick_death(u64 now)
+{
+    if( life_model == LIFE_PHASE && unif() <= life_arg[1] )
+        return ( now / (u64)life_arg[0] + 1 ) * (u64)life_arg[0];
+    return now + 1 + (u64)( -( life_model == LIFE_PHASE ? life_arg[2] : life_arg[0] ) * log( unif() ) );
+}
+
+/*
+ * pick_site - Call site of a block that lives life ops, -1 for the consumer
+ */
+static int pick_site(long long life)
+{
+    int s;
+
+    if( unif() <= 0.1 )
+        return rnd() % nsites;
+    if( life < 0 )
+        return nsites - 1;
+    s = log2( life + 1 ) * nsites / 24;
+    return s < nsites ? s : nsites - 1;
+}
+
+/*
+ * target - Live bytes the profile asks for at now
+ */
+static double target(u64 now)
+{
+    double t = (double)now / nops;
+
+    switch( profile ) {
+    case PROF_RAMP:
+        return maxbytes * t;
+    case PROF_PEAK:
+        return maxbytes * ( 1 - fabs( 2*t - 1 ) );
+    default:
+        return maxbytes * fmin( 1, fmin( t, 1 - t ) * 10 );
+    }
+}
+
+/*
+ * death_push, death_pop - Min-heap of pending frees
+ */
+static void death_push(u64 when, int id)
+{
+    int i = ndeaths++;
+
+    while( i && deaths[( i-1 ) / 2].when > when ) {
+        deaths[i] = deaths[( i-1 ) / 2];
+        i = ( i-1 ) / 2;
+    }
+    deaths[i].when = when;
+    deaths[i].id = id;
+}
+
+static int death_pop(void)
+{
+    int id = deaths[0].id;
+    struct death last = deaths[--ndeaths];
+    int i = 0, c;
+
+    while( ( c = 2*i + 1 ) < ndeaths ) {
+        if( c+1 < ndeaths && deaths[c+1].when < deaths[c].when )
+            c++;
+        if( last.when <= deaths[c].when )
+            break;
+        deaths[i] = deaths[c];
+        i = c;
+    }
+    deaths[i] = last;
+    return id;
+}
+
+/*
+ * put_op - Append one trace line; size is left out for frees, the site
+ *          when negative
+ */
+static void put_op(char type, int id, u64 size, int site)
+{
+    char tmp[48], *p = tmp + sizeof( tmp );
+    u64 v;
+
+    if( outlen > sizeof( outbuf ) - sizeof( tmp ) ) {
+        fwrite( outbuf, 1, outlen, out );
+        outlen = 0;
+    }
+    *--p = '\n';
+    if( site >= 0 ) {
+        v = site;
+        do *--p = '0' + v % 10; while( v /= 10 );
+        *--p = ' ';
+    }
+    if( type != 'f' ) {
+        v = size;
+        do *--p = '0' + v % 10; while( v /= 10 );
+        *--p = ' ';
+    }
+    v = id;
+    do *--p = '0' + v % 10; while( v /= 10 );
+    *--p = ' ';
+    *--p = type;
+    memcpy( outbuf + outlen, p, tmp + sizeof( tmp ) - p );
+    outlen += tmp + sizeof( tmp ) - p;
+}
+
+/*
+ * do_alloc - Allocate a new block and decide how it will die
+ */
+static void do_alloc(u64 now)
+{
+    int id = freeids[--nfreeids];
+    struct block *b = &blocks[id];
+    long long life = -1;
+    u64 when;
+
+    b->size = pick_size();
+    b->chainpos = -1;
+    b->steps = 0;
+    if( chain_p && unif() <= chain_p ) {
+        b->steps = 1 + rnd() % chain_steps;
+        b->chainpos = nchains;
+        chains[nchains++] = id;
+    }
+    if( handoff_p && unif() <= handoff_p )
+        fifo[( fifo_head + fifo_len++ ) % maxlive] = id;
+    else {
+        when = pick_death( now );
+        death_push( when, id );
+        life = when - now;
+    }
+    live++;
+    livebytes += b->size;
+    put_op( 'a', id, b->size, nsites ? pick_site( life ) : -1 );
+}
+
+/*
+ * drop_chain - Take block id out of the realloc chains
+ */
+static void drop_chain(int id)
+{
+    int pos = blocks[id].chainpos;
+
+    chains[pos] = chains[--nchains];
+    blocks[chains[pos]].chainpos = pos;
+    blocks[id].chainpos = -1;
+}
+
+/*
+ * do_realloc - Grow block id by the chain growth factor
+ */
+static void do_realloc(int id)
+{
+    struct block *b = &blocks[id];
+    u64 size = b->size * chain_growth + 1;
+
+    livebytes += size - b->size;
+    b->size = size;
+    if( b->chainpos >= 0 && --b->steps == 0 )
+        drop_chain( id );
+    put_op( 'r', id, size, -1 );
+}
+
+/*
+ * do_free - Free block id and recycle its id
+ */
+static void do_free(int id)
+{
+    if( blocks[id].chainpos >= 0 )
+        drop_chain( id );
+    live--;
+    livebytes -= blocks[id].size;
+    freeids[nfreeids++] = id;
+    put_op( 'f', id, 0, -1 );
+}
+
+/*
+ * fifo_pop - Oldest block handed to the consumer
+ */
+static int fifo_pop(void)
+{
+    int id = fifo[fifo_head];
+
+    fifo_head = ( fifo_head + 1 ) % maxlive;
+    fifo_len--;
+    return id;
+}
+
+/*
+ * parse_args - Split a comma separated model spec into its name and up to
+ *              n numbers; returns how many numbers there were
+ */
+static int parse_args(char *spec, const char **name, double *arg, int n)
+{
+    char *p;
+    int k = 0;
+
+    *name = spec;
+    for( p = strchr( spec, ',' ); p && k < n; p = strchr( p, ',' ) ) {
+        *p++ = '\0';
+        arg[k++] = strtod( p, &p );
+    }
+    return k;
+}
+
+static void usage(const char *prog)
+{
+    fprintf( stderr, "usage: %s [-n ops] [-l maxlive] [-s seed] [-z sizes] [-L lifetimes]\n"
+                     "       [-r p,steps,growth] [-c p,batch] [-p ramp|peak|plateau] [-b bytes]\n"
+                     "       [-S sites] [-o file]\n",
+             prog );
+    exit( 1 );
+}
+
+int main(int argc, char **argv)
+{
+    const char *name;
+    double arg[3];
+    u64 now;
+    int c, i, n;
+
+    out = stdout;
+    while( ( c = getopt( argc, argv, "n:l:s:z:L:r:c:p:b:S:o:" ) ) != -1 ) {
+        switch( c ) {
+        case 'n':
+            nops = strtoull( optarg, NULL, 0 );
+            break;
+        case 'l':
+            maxlive = atoi( optarg );
+            break;
+        case 's':
+            seed = strtoull( optarg, NULL, 0 );
+            break;
+        case 'z':
+            n = parse_args( optarg, &name, size_arg, 3 );
+            if( !strcmp( name, "uniform" ) && n == 2 )
+                size_model = SIZE_UNIFORM;
+            else if( !strcmp( name, "power" ) && n == 3 && size_arg[0] > 0 )
+                size_model = SIZE_POWER;
+            else if( !strcmp( name, "bimodal" ) && n == 3 )
+                size_model = SIZE_BIMODAL;
+            else
+                usage( argv[0] );
+            break;
+        case 'L':
+            n = parse_args( optarg, &name, life_arg, 3 );
+            if( !strcmp( name, "exp" ) && n == 1 )
+                life_model = LIFE_EXP;
+            else if( !strcmp( name, "phase" ) && n == 3 && life_arg[0] >= 1 )
+                life_model = LIFE_PHASE;
+            else
+                usage( argv[0] );
+            break;
+        case 'r':
+            if( parse_args( optarg, &name, arg, 2 ) != 2 || arg[0] < 1 )
+                usage( argv[0] );
+            chain_p = atof( name );
+            chain_steps = arg[0];
+            chain_growth = arg[1];
+            break;
+        case 'c':
+            if( parse_args( optarg, &name, arg, 1 ) != 1 || arg[0] < 1 )
+                usage( argv[0] );
+            handoff_p = atof( name );
+            handoff_batch = arg[0];
+            break;
+        case 'p':
+            if( !strcmp( optarg, "ramp" ) )
+                profile = PROF_RAMP;
+            else if( !strcmp( optarg, "peak" ) )
+                profile = PROF_PEAK;
+            else if( !strcmp( optarg, "plateau" ) )
+                profile = PROF_PLATEAU;
+            else
+                usage( argv[0] );
+            break;
+        case 'b':
+            maxbytes = strtoull( optarg, NULL, 0 );
+            break;
+        case 'S':
+            if( ( nsites = atoi( optarg ) ) < 1 )
+                usage( argv[0] );
+            break;
+        case 'o':
+            if( ( out = fopen( optarg, "w" ) ) == NULL ) {
+                perror( optarg );
+                exit( 1 );
+            }
+            break;
+        default:
+            usage( argv[0] );
+        }
+    }
+    if( optind != argc || maxlive < 1 )
+        usage( argv[0] );
+
+    blocks = malloc( maxlive * sizeof( *blocks ) );
+    freeids = malloc( maxlive * sizeof( *freeids ) );
+    deaths = malloc( maxlive * sizeof( *deaths ) );
+    fifo = malloc( maxlive * sizeof( *fifo ) );
+    chains = malloc( maxlive * sizeof( *chains ) );
+    if( !blocks || !freeids || !deaths || !fifo || !chains ) {
+        perror( "malloc" );
+        exit( 1 );
+    }
+    for( i = maxlive; i > 0; i-- )
+        freeids[nfreeids++] = i-1;
+
+    fprintf( out, "%llu\n%d\n%llu\n1\n", maxbytes, maxlive, nops );
+    for( now = 0; now < nops; now++ ) {
+        u64 left = nops - now;
+        int must_free = left <= (u64)live || live == maxlive;
+
+        if( left == (u64)live + 1 && live ) {
+            /* one op too many to free everything: spend it on a realloc */
+            do_realloc( ndeaths ? deaths[0].id : fifo[fifo_head] );
+        } else if( draining && fifo_len ) {
+            draining--;
+            do_free( fifo_pop() );
+        } else if( fifo_len >= handoff_batch ) {
+            draining = handoff_batch - 1;
+            do_free( fifo_pop() );
+        } else if( ndeaths && ( must_free || deaths[0].when <= now ||
+                                ( profile && livebytes > target( now ) ) ) ) {
+            do_free( death_pop() );
+        } else if( must_free && fifo_len ) {
+            do_free( fifo_pop() );
+        } else if( nchains && unif() <= chain_p ) {
+            do_realloc( chains[rnd() % nchains] );
+        } else {
+            do_alloc( now );
+        }
+    }
+    fwrite( outbuf, 1, outlen, out );
+    if( fclose( out ) ) {
+        perror( "gentrace" );
+        exit( 1 );
+    }
+    return 0;
+}
@@ -22,12 +22,38 @@
  *
  * The allocated prologue and epilogue blocks are overhead that
  * eliminate edge conditions during coalescing.
+ *
+ * A free block right before the epilogue of the main area is the top
+ * chunk. It is not on the free list: when nothing on the list fits,
+ * blocks are cut off its front, and new memory from the backend and
+ * blocks freed next to it simply make it longer.
+ *
+ * With cfg.defer set, freed blocks are not coalesced at once. They stay
+ * allocated as far as their neighbours are concerned, are marked PENDING
+ * and wait in a bin. When the bin overflows or nothing fits, one sweep
+ * sorts it by address and turns each run of adjacent blocks into a
+ * single free block.
+ *
+ * The free list is LIFO by default. MM_ORDER_ADDRESS keeps it sorted by
+ * address instead; a treap over the free blocks, linked through their
+ * payloads and keyed by address, finds each block's place in O(log n).
+ *
+ * Every routine works on a heap handle (see mm_ext.h). The mm_*
+ * interface is a thin wrapper over a default heap backed by memlib.
  */
+#define _GNU_SOURCE     /* mremap */
 #include <stdio.h>
 #include <unistd.h>
 #include <string.h>
 #include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "mm.h"
+#include "mm_ext.h"
 #include "memlib.h"
 
 /* Team structure */
@@ -43,20 +69,69 @@ team_t team = {
 #define DSIZE       8       /* doubleword size (bytes) */
 #define CHUNKSIZE   32      /* initial heap size (bytes) */
 #define OVERHEAD    32      /* overhead of header and footer (bytes) */
+#define MAXEXTENT   ((size_t)0xffe00000u) /* largest extent of heap memory, so any block size fits a tag */
 
 
 #define MAX(x, y) ((x) > (y)? (x) : (y))
+#define MIN(x, y) ((x) < (y)? (x) : (y))
 
 /* Pack a size and allocated bit into a word */
 #define PACK(size, alloc)  ((size) | (alloc))
 
+/*
+ * In the simulation build (-DMM_SIM) every metadata word lives in a side
+ * table indexed by its heap address rather than in the heap itself. The
+ * allocator makes exactly the same decisions, but payload pages are
+ * never written, faulted in or copied, so long traces replay fast. The
+ * table is the shadow array of the out-of-band build with a whole
+ * pointer per word, so free list links fit: twice the size of the
+ * metadata-bearing part of the heap, in pages that are only touched
+ * where metadata is.
+ */
+#ifdef MM_SIM
+typedef size_t oob_t;   /* contents of a side table slot */
+#define OOB_SLOT(p)     ( (size_t)(p) / WSIZE )
+#define OOB_GRAIN       WSIZE   /* bytes of address space per slot */
+#define OOB_LEAFBITS    22      /* slots per leaf, log2 */
+#elif defined(MM_OOB)
+/*
+ * In the out-of-band build (-DMM_OOB) headers and footers live in a
+ * shadow array with one 4-byte word per doubleword of address space, so
+ * the shadow of a heap of small blocks costs half its size again. Freeing
+ * and coalescing never write to the cache lines of neighbouring
+ * payloads. A header and the footer just below it always fall in
+ * different doublewords. Blocks keep their sizes, so placement is the
+ * same as in the normal build, word for word.
+ */
+typedef unsigned int oob_t;
+#define OOB_SLOT(p)     ( ( (size_t)(p) + WSIZE ) / DSIZE )
+#define OOB_GRAIN       DSIZE
+#define OOB_LEAFBITS    21
+#endif
+
+#if defined(MM_SIM) || defined(MM_OOB)
+static size_t oob_get(void *p);
+static oob_t *oob_word(void *p);
+static void oob_clear(char *lo, char *hi);
+
 /* Read and write a word at address p */
-#define GET(p)       (*(size_t *)(p))
-#define PUT(p, val)  (*(size_t *)(p) = (val))
+#define GET(p)       oob_get(p)
+#define PUT(p, val)  (*oob_word(p) = (val))
+#else
+/* Read and write a word at address p; tags are WSIZE bytes on every target */
+#define GET(p)       (*(unsigned int *)(p))
+#define PUT(p, val)  (*(unsigned int *)(p) = (val))
+#endif
 
 /* Read the size and allocated fields from address p */
 #define GET_SIZE(p)  (GET(p) & ~0x7)
 #define GET_ALLOC(p) (GET(p) & 0x1)
+#define GET_TAG(p)   (GET(p) & 0x2)
+
+/* Meaning of the tag bit, depending on the allocated bit */
+#define GROWN       0x2     /* allocated: realloc has grown this block before */
+#define HEADROOM    0x2     /* free: room kept for the allocated block below to grow into */
+#define PENDING     0x4     /* allocated: freed, waiting in the bin for the next sweep */
 
 /* Given block ptr bp, compute address of its header and footer */
 #define HDRP(bp)       ((char *)(bp) - WSIZE)
@@ -66,224 +141,2585 @@ team_t team = {
 #define NEXT_BLKP(bp)  ((char *)(bp) + GET_SIZE(((char *)(bp) - WSIZE)))
 #define PREV_BLKP(bp)  ((char *)(bp) - GET_SIZE(((char *)(bp) - DSIZE)))
 
+#ifdef MM_SIM
+#define NEXT_FREE(bp) (*(void **)oob_word((char *)(bp) + (2*WSIZE)))
+#define PREV_FREE(bp) (*(void **)oob_word(bp))
+#define LEFT_FREE(bp)  (*(void **)oob_word((char *)(bp) + (4*WSIZE)))
+#define RIGHT_FREE(bp) (*(void **)oob_word((char *)(bp) + (6*WSIZE)))
+#else
 #define NEXT_FREE(bp) (*(void **)(bp + (2*WSIZE)))    //computes address for next free block...linked list!!
 #define PREV_FREE(bp) (*(void **)(bp))            //computes address for previous free block...linked list!!
+#define LEFT_FREE(bp)  (*(void **)((char *)(bp) + (4*WSIZE)))   /* treap children: address order only */
+#define RIGHT_FREE(bp) (*(void **)((char *)(bp) + (6*WSIZE)))
+#endif
+
+/* smallest free block the free list of h can hold: address order needs room for the tree links */
+#define TREE_MIN    (OVERHEAD + DSIZE)
+#define MIN_FREE(h) ((h)->cfg.order == MM_ORDER_ADDRESS ? TREE_MIN : OVERHEAD)
+
+/* bookkeeping hooks that only do something in the simulation build */
+#ifdef MM_SIM
+#define SIM_ALLOC(h, bp, size)  sim_alloc(h, bp, size)
+#define SIM_FREE(h, bp)         sim_free(h, bp)
+#else
+#define SIM_ALLOC(h, bp, size)
+#define SIM_FREE(h, bp)
+#endif
+
+/* forget the shadow words of memory going back to the system */
+#if defined(MM_SIM) || defined(MM_OOB)
+#define OOB_CLEAR(lo, hi)       oob_clear(lo, hi)
+#else
+#define OOB_CLEAR(lo, hi)
+#endif
+
+/*
+ * Write the padding word at the aligned start of a region. Out of band
+ * it is never written: its shadow slot is the one of the word below it,
+ * which may be the epilogue of the region just before.
+ */
+#ifdef MM_OOB
+#define PUT_PAD(p)
+#else
+#define PUT_PAD(p)              PUT(p, 0)
+#endif
+
+#if defined(MM_SIM) && defined(MM_OOB)
+#error "MM_SIM and MM_OOB are different metadata layouts; pick one"
+#endif
 
 #define ALIGN(size) ((size + 7) & ~0x7) //rounds to nearest multiple of 8
 
+#define MAXSEGS     64      /* max extra regions chained onto one heap */
+#define SEGOVERHEAD (2*DSIZE) /* pad, prologue and epilogue of a region */
+#define SEGSIZE     (1<<20) /* minimum size of a mapped segment (bytes) */
+#define COMMITSIZE  (1<<16) /* granularity of commits in a reserved area */
+#define HUGESIZE    (1<<21) /* transparent huge page size (bytes) */
+#define FIXEDSIZE   (1<<28) /* default reservation in deterministic mode */
+#define TRIM_THRESHOLD (1<<18) /* free bytes at the top that trigger a trim */
+#define MOVE_THRESHOLD (1<<20) /* realloc moves this big bypass the cache */
+
+#define PAGE_ROUND(size, page) (((size) + (page)-1) & ~((page)-1)) //rounds up to a page boundary
+
+/* internal heap flags, above the public MM_HEAP_* bits */
+#define HEAP_MAPPED 0x100   /* main area was mapped by the allocator */
+#define HEAP_FIXED  0x200   /* mappings go at fixed, reproducible addresses */
+
+/* segment flags */
+#define SEG_MAPPED  0x1     /* segment was mapped by the allocator */
+
+/* lifetime arenas of a heap */
+#define ARENA_SHORT 0       /* MM_SHORT_LIVED blocks */
+#define ARENA_LONG  1       /* MM_LONG_LIVED blocks */
+#define NARENAS     2
+
+/* call-site lifetime prediction */
+#define NSITES      1024    /* allocation sites tracked per heap */
+#define NSAMPLES    256     /* sampled blocks awaiting their free */
+#define SAMPLE_RATE 32      /* one allocation in this many is sampled */
+#define SITE_MIN    4       /* samples a site needs before it is predicted */
+#define SITE_MAX    256     /* counts are halved here, so sites can change */
+
+/* page map: 48-bit addresses in three levels of 4096 entries over 4 KiB pages */
+#define PM_SHIFT    12      /* log2 of the page size the map works in */
+#define PM_BITS     12      /* page number bits resolved per level */
+#define PM_LEN      ( 1 << PM_BITS )
+/* page number the map does not cover; widened so the shift is defined for 32-bit size_t */
+#define PM_BEYOND(pn) ( (unsigned long long)(pn) >> ( 3*PM_BITS ) )
+
+/* out-of-band and simulated metadata: shadow slots in three levels, the last 2^OOB_LEAFBITS long */
+#define OOB_BITS    12      /* index bits of the two upper levels */
+
+#define CKPT_MAGIC  0x6d6d636b /* "mmck": start of a checkpoint file */
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0   /* older kernels: the address is only a hint */
+#endif
+#ifndef MREMAP_DONTUNMAP
+#define MREMAP_DONTUNMAP 4      /* older headers; the kernel may still refuse it */
+#endif
+
+/*
+ * A region chained onto a heap. It carries its own prologue and epilogue
+ * so coalescing never runs across the gap between two regions.
+ */
+struct mm_seg {
+    char *base;         /* first byte of the region */
+    size_t len;         /* length of the region in bytes */
+    unsigned flags;     /* SEG_* flags */
+};
+
+/*
+ * A backend supplies the main area of a heap. extend_heap only ever asks
+ * it to move the break up; backends that can give memory back also
+ * provide trim to move it down again.
+ */
+struct mm_backend {
+    void *(*sbrk)(mm_heap_t *h, size_t incr);   /* old break or (void *)-1 */
+    void (*trim)(mm_heap_t *h, size_t decr);    /* lower the break, or NULL */
+    void *(*lo)(mm_heap_t *h);                  /* first byte of the area */
+    void *(*hi)(mm_heap_t *h);                  /* last byte in use */
+};
+
+/*
+ * All allocator state lives in a heap handle so that a process can run
+ * several independent heaps side by side. The mm_* interface works on
+ * default_heap, which grows through mem_sbrk; heaps made by
+ * mm_heap_create carve their blocks out of a private mapping instead,
+ * and buffer heaps out of memory handed in by the caller.
+ */
+struct mm_heap {
+    char *heap_listp;   /* pointer to first block */
+    char *free_listp;   //pointer to the start of the freelist
+    char *top;          /* free block ending the main area, kept off the free list */
+    size_t maxfree;     /* no block on the free list is larger than this */
+    char *pending;      /* freed blocks not coalesced yet, linked through NEXT_FREE */
+    char *tree;         /* root of the treap over the free list (MM_ORDER_ADDRESS) */
+    char *rover;        /* where the next next-fit search starts (NULL: the head) */
+    size_t npending;    /* number of blocks in the bin */
+    const struct mm_backend *backend; /* where the main area comes from */
+    char *map;          /* start of the mapping holding the main area */
+    char *lo;           /* first byte of a private region (NULL: memlib) */
+    char *brk;          /* current break within the private region */
+    char *end;          /* one past the last byte of the private region */
+    char *committed;    /* end of the accessible part of a reserved area */
+    char *seg_next;     /* where the next segment goes in a fixed heap */
+    unsigned flags;     /* MM_HEAP_* and HEAP_* flags */
+    struct mm_config cfg; /* placement and growth policy */
+    size_t mapped;      /* bytes in mapped segments */
+    size_t maxmapped;   /* limit on mapped (0: none) */
+    char *spare;        /* base of an empty segment kept mapped for reuse (NULL: none) */
+    size_t peak;        /* largest size the heap has had */
+    size_t reserved;    /* size trims and segment releases never go below (mm_heap_reserve) */
+    mm_heap_t *arena[NARENAS]; /* heaps for lifetime-hinted blocks, made on first use */
+    size_t arena_peak;  /* largest size of the heap and its arenas together */
+    struct mm_predict *predict; /* call-site prediction state (NULL: off) */
+    mm_heap_t *parent;  /* heap this is a lifetime arena of (NULL: none) */
+    size_t payload;     /* requested bytes in allocated blocks (MM_SIM only) */
+    size_t peak_payload; /* largest payload so far (MM_SIM only) */
+    int nsegs;          /* number of chained regions */
+    struct mm_seg segs[MAXSEGS];
+};
+
+/* function prototypes for the backends */
+static void *memlib_sbrk(mm_heap_t *h, size_t incr);
+static void *memlib_lo(mm_heap_t *h);
+static void *memlib_hi(mm_heap_t *h);
+static void *region_sbrk(mm_heap_t *h, size_t incr);
+static void *region_lo(mm_heap_t *h);
+static void *region_hi(mm_heap_t *h);
+static void *reserve_sbrk(mm_heap_t *h, size_t incr);
+static void reserve_trim(mm_heap_t *h, size_t decr);
+
+/* classic memlib heap, grown with mem_sbrk */
+static const struct mm_backend memlib_backend = {
+    memlib_sbrk, NULL, memlib_lo, memlib_hi
+};
+
+/* fully accessible private mapping or caller buffer */
+static const struct mm_backend region_backend = {
+    region_sbrk, NULL, region_lo, region_hi
+};
+
+/* inaccessible reservation, committed and decommitted page by page */
+static const struct mm_backend reserve_backend = {
+    reserve_sbrk, reserve_trim, region_lo, region_hi
+};
+
+/*
+ * Lifetimes learned per allocation site. A sample remembers when and
+ * where a block was allocated; its free, or its eviction by a younger
+ * sample once it is older than the threshold, tells the site whether
+ * its blocks tend to be short- or long-lived.
+ */
+struct mm_site {
+    void *site;         /* caller's return address (NULL: empty) */
+    unsigned nshort;    /* samples freed within the threshold */
+    unsigned nlong;     /* samples that outlived it */
+};
+
+struct mm_sample {
+    void *bp;           /* sampled block (NULL: empty) */
+    struct mm_site *site;
+    unsigned long long birth; /* clock at allocation */
+};
+
+struct mm_predict {
+    size_t lifetime;    /* operations after which a block is long-lived */
+    unsigned long long clock; /* allocations and frees so far */
+    struct mm_site sites[NSITES];
+    struct mm_sample samples[NSAMPLES];
+};
+
+/*
+ * The page map records, for every page the allocator mapped, the heap
+ * it belongs to, so the owner of a pointer is three loads away however
+ * many heaps, arenas and segments there are. It is shared by all heaps
+ * and threads: nodes are installed with a compare and swap and never
+ * freed, and each entry is only written by the heap that owns the page.
+ * Memory handed in by the caller and the memlib heap are not recorded,
+ * as they need not start or end on a page boundary.
+ */
+struct pm_leaf {
+    mm_heap_t *heap[PM_LEN];
+};
+
+struct pm_node {
+    struct pm_leaf *leaf[PM_LEN];
+};
+
+static struct pm_node *page_map[PM_LEN];
+
+/*
+ * Header of a checkpoint file. Each extent's bytes follow it, every one
+ * starting on a page boundary so that it can be mapped straight back.
+ * ext[0] is the main area, the rest are mapped segments.
+ */
+struct mm_ckpt {
+    unsigned magic;     /* CKPT_MAGIC */
+    int inside;         /* handle is stored in the main area */
+    int next;           /* number of extents */
+    mm_heap_t heap;     /* the handle as it was */
+    struct mm_seg ext[MAXSEGS+1];
+};
+
 /* Global variables */
-static char *heap_listp;  /* pointer to first block */
-static char *free_listp;  //pointer to the start of the freelist
+static mm_heap_t default_heap;  /* heap behind the mm_* interface */
 
 /* function prototypes for internal helper routines */
-static void *extend_heap(size_t words);
-static void place(void *bp, size_t asize);
-static void *find_fit(size_t asize);
-static void *coalesce(void *bp);
-static void freelist(void *bp);
-static void delete_block(void *bp);
-static int check_block(void *bp);
+static int heap_init(mm_heap_t *h);
+static void *map_area(mm_heap_t **hp, char *addr, size_t len, unsigned flags);
+static char *map_pages(char *addr, size_t len, int prot, unsigned flags);
+static size_t heap_pagesize(unsigned flags);
+static void heap_release(mm_heap_t *h);
+static void *heap_sbrk(mm_heap_t *h, size_t incr);
+static void *heap_lo(mm_heap_t *h);
+static void *heap_hi(mm_heap_t *h);
+static void trim_heap(mm_heap_t *h, void *bp);
+#ifndef MM_SIM
+static void touch_pages(char *lo, char *hi);
+#endif
+static int heap_checkpoint(mm_heap_t *h, const char *path);
+static mm_heap_t *heap_restore(mm_heap_t *h, const char *path);
+static int restore_area(struct mm_ckpt *ck, int fd, size_t off);
+static int restore_room(mm_heap_t *h, char *base, size_t len);
+static int in_heap(mm_heap_t *h, void *p);
+static mm_heap_t *owner(mm_heap_t *h, void *bp);
+static mm_heap_t *page_owner(void *p);
+static struct pm_leaf *page_leaf(size_t pn, int make);
+static int page_map_set(char *lo, char *hi, mm_heap_t *h);
+static void arena_peak(mm_heap_t *h);
+static int can_map(mm_heap_t *h);
+static int can_configure(mm_heap_t *h, const struct mm_config *cfg);
+static void apply_config(mm_heap_t *h, const struct mm_config *cfg);
+static void *heap_malloc(mm_heap_t *h, size_t size);
+static struct mm_site *site_lookup(struct mm_predict *p, void *site);
+static void site_record(struct mm_site *s, int long_lived);
+static struct mm_sample *sample_slot(struct mm_predict *p, mm_heap_t *h, void *bp);
+static void sample_alloc(struct mm_predict *p, mm_heap_t *h, void *bp, struct mm_site *s);
+static void sample_free(struct mm_predict *p, mm_heap_t *h, void *bp);
+static void heap_stats(mm_heap_t *h, struct mm_stats *st);
+static void *add_segment(mm_heap_t *h, char *base, size_t len);
+static void *map_segment(mm_heap_t *h, size_t size);
+static int release_segment(mm_heap_t *h, void *bp);
+static void *extend_heap(mm_heap_t *h, size_t words);
+static void place(mm_heap_t *h, void *bp, size_t asize);
+static void *alloc_block(mm_heap_t *h, size_t asize);
+static void *bump_top(mm_heap_t *h, size_t asize);
+static int grow_block(mm_heap_t *h, void *bp, size_t asize);
+static void shrink_block(mm_heap_t *h, void *bp, size_t asize);
+static void *alloc_congruent(mm_heap_t *h, size_t asize, char *ptr);
+static int mapped_range(mm_heap_t *h, char *p, size_t len);
+static void move_payload(mm_heap_t *h, char *dst, char *src, size_t len);
+#ifndef MM_SIM
+static int remap_payload(mm_heap_t *h, char *dst, char *src, size_t len);
+#endif
+static void *find_fit(mm_heap_t *h, size_t asize);
+static void *coalesce(mm_heap_t *h, void *bp);
+static void free_block(mm_heap_t *h, void *bp);
+static void sweep_pending(mm_heap_t *h);
+static void *sort_pending(void *list, size_t n);
+static void freelist(mm_heap_t *h, void *bp);
+static void delete_block(mm_heap_t *h, void *bp);
+static void reorder_free_list(mm_heap_t *h);
+static unsigned tree_prio(void *bp);
+static void *tree_insert(void *root, void *bp);
+static void *tree_delete(void *root, void *bp);
+static void *tree_join(void *a, void *b);
+static int check_block(mm_heap_t *h, void *bp);
+static size_t adjust_size(mm_heap_t *h, size_t size);
+static unsigned long long digest_word(unsigned long long hash, size_t w);
+static size_t heap_size(mm_heap_t *h);
+#ifdef MM_SIM
+static void sim_alloc(mm_heap_t *h, void *bp, size_t size);
+static void sim_free(mm_heap_t *h, void *bp);
+#endif
+
+/*
+ * mm_init - Initialize the memory manager
+ */
+int mm_init(void)
+{
+    char *base = getenv( "MM_HEAP_BASE" );
+    char *size = getenv( "MM_HEAP_SIZE" );
+
+    /* deterministic mode: the heap lands on the same addresses every run */
+    if( base && *base )
+        return mm_init_at( (void *)(size_t)strtoull( base, NULL, 0 ),
+                           size ? (size_t)strtoull( size, NULL, 0 ) : FIXEDSIZE,
+                           MM_HEAP_RESERVE );
+
+    heap_release( &default_heap );
+    memset( &default_heap, 0, sizeof( default_heap ) );
+    default_heap.backend = &memlib_backend;
+    return heap_init( &default_heap );
+}
+
+/*
+ * mm_init_reserve - Initialize the memory manager over a reservation of
+ *                   maxsize bytes of address space instead of memlib.
+ *                   Pages are committed as the heap grows and returned
+ *                   when the top of the heap is freed.
+ */
+int mm_init_reserve(size_t maxsize)
+{
+    return mm_init_ex( maxsize, MM_HEAP_RESERVE );
+}
+
+/*
+ * mm_init_ex - Initialize the memory manager with the same MM_HEAP_* flags
+ *              as mm_heap_create_ex. With no flags this is mm_init.
+ */
+int mm_init_ex(size_t maxsize, unsigned flags)
+{
+    return mm_init_at( NULL, maxsize, flags );
+}
+
+/*
+ * mm_init_at - Initialize the memory manager like mm_init_ex, but with the
+ *              heap mapped at base (if not NULL). Together with a fixed
+ *              operation sequence this makes every address reproducible.
+ */
+int mm_init_at(void *base, size_t maxsize, unsigned flags)
+{
+    mm_heap_t *h = &default_heap;
+
+    if( !base && !flags )
+        return mm_init();
+    heap_release( h );
+    memset( h, 0, sizeof( default_heap ) );
+    if( map_area( &h, base, maxsize, flags ) == NULL ) {
+        h->backend = &memlib_backend;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * mm_malloc - Allocate a block with at least size bytes of payload
+ */
+void *mm_malloc(size_t size)
+{
+    return mm_heap_malloc_site( &default_heap, size, __builtin_return_address( 0 ) );
+}
+
+/*
+ * mm_free - Free a block
+ */
+void mm_free(void *bp)
+{
+    mm_heap_t *h = mm_heap_of( bp );
+
+    mm_heap_free( h ? h : &default_heap, bp );
+}
+
+/*
+ * mm_realloc - Resize a block in the heap it came from
+ */
+void *mm_realloc(void *ptr, size_t size)
+{
+    mm_heap_t *h = mm_heap_of( ptr );
+
+    return mm_heap_realloc( h ? h : &default_heap, ptr, size );
+}
+
+/*
+ * mm_checkheap - Check the heap for consistency
+ */
+int mm_checkheap(void)
+{
+    return mm_heap_checkheap( &default_heap );
+}
+
+/*
+ * mm_heap_create - Create an independent heap in a private mapping of
+ *                  maxsize bytes. Pages are only backed once touched.
+ */
+mm_heap_t *mm_heap_create(size_t maxsize)
+{
+    return mm_heap_create_ex( maxsize, 0 );
+}
+
+/*
+ * mm_heap_create_ex - Create an independent heap with MM_HEAP_* flags.
+ *                     A MM_HEAP_SEGMENTED heap maps only a small home
+ *                     region up front and grows by mapping separate
+ *                     segments, up to maxsize bytes of them (0: no limit).
+ *                     A MM_HEAP_RESERVE heap reserves maxsize bytes of
+ *                     address space and commits them as it grows.
+ *                     MM_HEAP_HUGEPAGE lays either out for huge pages.
+ */
+mm_heap_t *mm_heap_create_ex(size_t maxsize, unsigned flags)
+{
+    return mm_heap_create_at( NULL, maxsize, flags );
+}
+
+/*
+ * mm_heap_create_at - Create a heap like mm_heap_create_ex, with its main
+ *                     area mapped at base and any segments right above it.
+ *                     Fails if the address range is not free.
+ */
+mm_heap_t *mm_heap_create_at(void *base, size_t maxsize, unsigned flags)
+{
+    mm_heap_t *h = NULL;
+
+    return map_area( &h, base, maxsize, flags );
+}
+
+/*
+ * mm_heap_create_in_buffer - Create a heap, handle included, inside the
+ *                            len bytes at buf. It never asks the system
+ *                            for memory; allocations fail once buf is full.
+ */
+mm_heap_t *mm_heap_create_in_buffer(void *buf, size_t len)
+{
+    mm_heap_t *h;
+    char *start = (char *)ALIGN( (size_t)buf );
+
+    if( !buf || len < (size_t)( start - (char *)buf ) + ALIGN( sizeof( mm_heap_t ) ) )
+        return NULL;
+    h = (mm_heap_t *)start;
+    memset( h, 0, sizeof( mm_heap_t ) );
+    h->backend = &region_backend;
+    h->lo = start + ALIGN( sizeof( mm_heap_t ) );
+    h->brk = h->lo;
+    h->end = (char *)buf + MIN( len, MAXEXTENT );
+    if( heap_init( h ) == -1 )
+        return NULL;
+    return h;
+}
+
+/*
+ * mm_init_in_buffer - Initialize the default heap inside the len bytes at
+ *                     buf instead of growing it through mem_sbrk
+ */
+int mm_init_in_buffer(void *buf, size_t len)
+{
+    mm_heap_t *h = &default_heap;
+
+    if( !buf )
+        return -1;
+    heap_release( h );
+    memset( h, 0, sizeof( mm_heap_t ) );
+    h->backend = &region_backend;
+    h->lo = (char *)ALIGN( (size_t)buf );
+    h->brk = h->lo;
+    h->end = (char *)buf + MIN( len, MAXEXTENT );
+    if( h->end < h->lo || heap_init( h ) == -1 ) {
+        h->backend = &memlib_backend;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * mm_add_region, mm_heap_add_region - Chain another caller-supplied region
+ *                                     onto a heap as one large free block
+ */
+int mm_add_region(void *buf, size_t len)
+{
+    return mm_heap_add_region( &default_heap, buf, len );
+}
+
+int mm_heap_add_region(mm_heap_t *h, void *buf, size_t len)
+{
+    if( !h || !buf )
+        return -1;
+    return add_segment( h, buf, len ) ? 0 : -1;
+}
+
+/*
+ * mm_heap_destroy - Release a heap and every block in it at once. Buffer
+ *                   heaps are simply abandoned; their memory is the caller's.
+ */
+void mm_heap_destroy(mm_heap_t *h)
+{
+    if( !h || h == &default_heap )
+        return;
+    heap_release( h );
+}
+
+/*
+ * mm_heap_of - The heap a block was allocated from, looked up in the page
+ *              map. NULL for blocks of buffer heaps and the memlib heap,
+ *              which the map does not cover.
+ */
+mm_heap_t *mm_heap_of(void *ptr)
+{
+    mm_heap_t *h = page_owner( ptr );
+
+    return h && h->parent ? h->parent : h;
+}
+
+/*
+ * mm_heap_malloc - Allocate a block with at least size bytes of payload from h
+ */
+void *mm_heap_malloc(mm_heap_t *h, size_t size)
+{
+    return mm_heap_malloc_site( h, size, __builtin_return_address( 0 ) );
+}
+
+/*
+ * mm_heap_malloc_site - Allocate from h on behalf of allocation site site.
+ *                       With prediction on, blocks from sites whose
+ *                       sampled blocks mostly outlived the threshold go
+ *                       to the long-lived arena. Wrappers around the
+ *                       allocator pass their own caller here.
+ */
+void *mm_heap_malloc_site(mm_heap_t *h, size_t size, void *site)
+{
+    struct mm_predict *p = h->predict;
+    struct mm_site *s;
+    void *bp;
+
+    if( !p || !site )
+        return heap_malloc( h, size );
+    p->clock++;
+    s = site_lookup( p, site );
+    if( s && s->nshort + s->nlong >= SITE_MIN && s->nlong > s->nshort )
+        bp = mm_heap_malloc_hint( h, size, MM_LONG_LIVED );
+    else
+        bp = heap_malloc( h, size );
+    if( bp && s && p->clock % SAMPLE_RATE == 0 )
+        sample_alloc( p, owner( h, bp ), bp, s );
+    return bp;
+}
+
+/*
+ * mm_predict - Turn call-site lifetime prediction on the default heap on
+ *              or off
+ */
+int mm_predict(size_t lifetime)
+{
+    return mm_heap_predict( &default_heap, lifetime );
+}
+
+/*
+ * mm_heap_predict - Learn the lifetimes of blocks per allocation site and
+ *                   put blocks from sites that turn out long-lived, those
+ *                   whose blocks live more than lifetime allocations and
+ *                   frees, in a separate arena. 0 turns it off again and
+ *                   forgets what was learned. Fails in heaps that cannot
+ *                   have arenas.
+ */
+int mm_heap_predict(mm_heap_t *h, size_t lifetime)
+{
+    struct mm_predict *p = h->predict;
+
+    if( !lifetime ) {
+        if( p )
+            munmap( p, sizeof( *p ) );
+        h->predict = NULL;
+        return 0;
+    }
+    if( !can_map( h ) )
+        return -1;
+    if( !p ) {
+        p = mmap( NULL, sizeof( *p ), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+        if( p == MAP_FAILED )
+            return -1;
+        h->predict = p;
+    }
+    p->lifetime = lifetime;
+    return 0;
+}
+
+/*
+ * heap_malloc - Allocate a block of size bytes from h itself
+ */
+static void *heap_malloc(mm_heap_t *h, size_t size)
+{
+    char *bp;
+
+    /* Ignore spurious requests, and ones no block size could hold */
+    if( size <= 0 || size > MAXEXTENT )
+        return NULL;
+
+    /* Adjust block size to include overhead and alignment reqs. */
+    if( ( bp = alloc_block( h, adjust_size( h, size ) ) ) == NULL )
+        return NULL;
+    SIM_ALLOC( h, bp, size );
+    if( h->arena[ARENA_SHORT] || h->arena[ARENA_LONG] )
+        arena_peak( h );
+    return bp;
+}
+
+/*
+ * mm_malloc_hint - Allocate from the default heap, kept apart from blocks
+ *                  of other expected lifetimes
+ */
+void *mm_malloc_hint(size_t size, unsigned hint)
+{
+    return mm_heap_malloc_hint( &default_heap, size, hint );
+}
+
+/*
+ * mm_heap_malloc_hint - Allocate a block of h in the arena for its expected
+ *                       lifetime, so short-lived blocks do not pin holes
+ *                       between long-lived ones. The arenas are heaps of
+ *                       their own, made on first use like h (segmented
+ *                       for a memlib heap); free and realloc find them
+ *                       from the block address. Without a single hint,
+ *                       or in a heap that must not map memory, this is
+ *                       mm_heap_malloc.
+ */
+void *mm_heap_malloc_hint(mm_heap_t *h, size_t size, unsigned hint)
+{
+    void *bp;
+    unsigned flags;
+    int i;
+
+    if( hint == MM_SHORT_LIVED )
+        i = ARENA_SHORT;
+    else if( hint == MM_LONG_LIVED )
+        i = ARENA_LONG;
+    else
+        return heap_malloc( h, size );
+
+    if( !h->arena[i] ) {
+        if( !can_map( h ) )
+            return heap_malloc( h, size );
+        if( h->flags & HEAP_MAPPED ) {
+            /* same kind and size of heap as h */
+            flags = h->flags & ( MM_HEAP_SEGMENTED | MM_HEAP_RESERVE | MM_HEAP_HUGEPAGE );
+            h->arena[i] = mm_heap_create_ex( ( flags & MM_HEAP_SEGMENTED ) ? h->maxmapped : (size_t)( h->end - h->map ), flags );
+        }
+        else
+            h->arena[i] = mm_heap_create_ex( 0, MM_HEAP_SEGMENTED );
+        if( !h->arena[i] )
+            return heap_malloc( h, size );
+        h->arena[i]->cfg = h->cfg;
+        h->arena[i]->parent = h;
+    }
+    if( ( bp = heap_malloc( h->arena[i], size ) ) != NULL )
+        arena_peak( h );
+    return bp;
+}
+
+/*
+ * mm_heap_free - Free a block of h. Blocks freed in the reverse order
+ *                they were cut from the top chunk just give it back,
+ *                without going near the free list. With cfg.defer set
+ *                other blocks only go into the pending bin.
+ */
+void mm_heap_free(mm_heap_t *h, void *bp)
+{
+    if(!bp)
+      return;
+    if( h->predict ) {
+        h->predict->clock++;
+        sample_free( h->predict, owner( h, bp ), bp );
+    }
+    h = owner( h, bp );
+    SIM_FREE( h, bp );
+
+    size_t size = GET_SIZE( HDRP( bp ) );
+
+    /* the last block cut from the top chunk: roll the top back over it */
+    if( NEXT_BLKP( bp ) == h->top && GET_ALLOC( HDRP( bp ) - WSIZE ) ) {
+        size += GET_SIZE( HDRP( h->top ) );
+        PUT( HDRP( bp ), PACK( size, 0 ) );
+        PUT( FTRP( bp ), PACK( size, 0 ) );
+        h->top = bp;
+        if( h->backend->trim && size >= TRIM_THRESHOLD )
+            trim_heap( h, bp );
+        return;
+    }
+
+    if( h->cfg.defer ) {
+        /* still allocated to its neighbours until the next sweep */
+        PUT( HDRP( bp ), PACK( size, 1 ) | PENDING );
+        PUT( FTRP( bp ), PACK( size, 1 ) | PENDING );
+        NEXT_FREE( bp ) = h->pending;
+        h->pending = bp;
+        if( ++h->npending > h->cfg.defer )
+            sweep_pending( h );
+        return;
+    }
+
+    PUT( HDRP( bp ), PACK( size, 0 ) );
+    PUT( FTRP( bp ), PACK( size, 0 ) );
+    free_block( h, bp );
+}
+
+/*
+ * mm_heap_realloc - Resize a block of h. A block that already fits the
+ *                   new size stays where it is and gives back a tail big
+ *                   enough to split off. A block that grows is marked
+ *                   GROWN; once it grows again it is given headroom,
+ *                   half as much again as asked for, so a run of small
+ *                   growths completes in place instead of copying each
+ *                   time.
+ */
+void *mm_heap_realloc(mm_heap_t *h, void *ptr, size_t size)
+{
+
+    void *newp;
+    size_t copySize, asize, nsize, grown;
+    struct mm_predict *p = h->predict;
+    struct mm_sample *sp;
+
+    if( !ptr )
+        return heap_malloc( h, size );
+    if( size <= 0 ) {
+        mm_heap_free( h, ptr );
+        return NULL;
+    }
+    if( size > MAXEXTENT )
+        return NULL;    /* too big for any block: ptr is left untouched */
+    h = owner( h, ptr );    /* a hinted block stays in its arena */
+    asize = adjust_size( h, size );
+    grown = GET_TAG( HDRP( ptr ) );
+
+    /* same capacity or a shrink; a GROWN block keeps its tail unless halved */
+    if( size <= GET_SIZE( HDRP( ptr ) ) - DSIZE ) {
+        if( asize < GET_SIZE( HDRP( ptr ) ) && ( !grown || asize < GET_SIZE( HDRP( ptr ) ) / 2 ) )
+            shrink_block( h, ptr, asize );
+        SIM_FREE( h, ptr );
+        SIM_ALLOC( h, ptr, size );
+        return ptr;
+    }
+
+    /* growing: the successor may have the room */
+    if( grow_block( h, ptr, asize ) ) {
+        SIM_FREE( h, ptr );
+        SIM_ALLOC( h, ptr, size );
+        return ptr;
+    }
+
+    /* move, taking headroom along if the block keeps growing */
+    copySize = GET_SIZE( HDRP( ptr ) ) - DSIZE;
+    nsize = grown ? adjust_size( h, size + size/2 ) : asize;
+    newp = NULL;
+    if( copySize >= MOVE_THRESHOLD && mapped_range( h, ptr, copySize ) )
+        newp = alloc_congruent( h, nsize, ptr );    /* its pages can be remapped */
+    if( !newp )
+        newp = alloc_block( h, nsize );
+    if( !newp && ( !grown || ( newp = alloc_block( h, asize ) ) == NULL ) )
+        return NULL;    /* out of memory: ptr is left untouched */
+    PUT( HDRP( newp ), GET( HDRP( newp ) ) | GROWN );
+    PUT( FTRP( newp ), GET( FTRP( newp ) ) | GROWN );
+    move_payload( h, newp, ptr, copySize );
+    SIM_ALLOC( h, newp, size );
+    if( p && ( sp = sample_slot( p, h, ptr ) )->bp == ptr ) {
+        /* a sampled block keeps its birth when it moves */
+        struct mm_sample moved = *sp;
+
+        sp->bp = NULL;
+        sample_alloc( p, h, newp, moved.site );
+        if( ( sp = sample_slot( p, h, newp ) )->bp == newp )
+            sp->birth = moved.birth;
+    }
+    mm_heap_free( h, ptr );
+    return newp;
+}
+
+/*
+ * mm_reserve - Grow the default heap by bytes ahead of time
+ */
+int mm_reserve(size_t bytes, unsigned flags)
+{
+    return mm_heap_reserve( &default_heap, bytes, flags );
+}
+
+/*
+ * mm_heap_reserve - Grow h by bytes now and put the new space on the free
+ *                   list, so later allocations are served without growing
+ *                   the heap. MM_RESERVE_PREFAULT also takes the page
+ *                   faults now and MM_RESERVE_LOCK pins the pages in RAM.
+ *                   The heap is not trimmed below its size after this,
+ *                   so the space stays reserved across frees. If the
+ *                   pages cannot be locked it returns -1; the heap keeps
+ *                   the new space, but as ordinary free space that a
+ *                   trim may give back.
+ */
+int mm_heap_reserve(mm_heap_t *h, size_t bytes, unsigned flags)
+{
+    char *bp;
+#ifndef MM_SIM
+    char *lo, *hi;
+    size_t pagesize = mem_pagesize();
+#endif
+
+    if( ( bp = extend_heap( h, ( bytes + WSIZE-1 ) / WSIZE ) ) == NULL )
+        return -1;
+
+#ifndef MM_SIM
+    /* the new space may have merged with a free block below it */
+    lo = (char *)( (size_t)bp & ~( pagesize-1 ) );
+    hi = bp + GET_SIZE( HDRP( bp ) ) - DSIZE;
+    if( flags & MM_RESERVE_PREFAULT ) {
+#ifdef MADV_POPULATE_WRITE
+        if( madvise( lo, hi - lo, MADV_POPULATE_WRITE ) == -1 )
+#endif
+            touch_pages( bp, hi );
+    }
+    if( ( flags & MM_RESERVE_LOCK ) && mlock( lo, hi - lo ) == -1 )
+        return -1;
+#else
+    /* nothing is ever touched, so there is nothing to fault in or lock */
+    (void)flags;
+#endif
+    h->reserved = heap_size( h );
+    return 0;
+}
+
+/*
+ * mm_checkpoint - Write the default heap and its metadata to path
+ */
+int mm_checkpoint(const char *path)
+{
+    return heap_checkpoint( &default_heap, path );
+}
+
+/*
+ * mm_restore - Bring back the default heap from a checkpoint, at the
+ *              addresses it had, so every pointer into it stays valid
+ */
+int mm_restore(const char *path)
+{
+    return heap_restore( &default_heap, path ) ? 0 : -1;
+}
+
+/*
+ * mm_heap_checkpoint - Write heap h, handle included, to path
+ */
+int mm_heap_checkpoint(mm_heap_t *h, const char *path)
+{
+    if( !h || h == &default_heap )
+        return -1;
+    return heap_checkpoint( h, path );
+}
+
+/*
+ * mm_heap_restore - Map a heap written by mm_heap_checkpoint back at its
+ *                   old addresses and return its handle
+ */
+mm_heap_t *mm_heap_restore(const char *path)
+{
+    return heap_restore( NULL, path );
+}
+
+/*
+ * mm_digest - Hash of the default heap's layout
+ */
+unsigned long long mm_digest(void)
+{
+    return mm_heap_digest( &default_heap );
+}
+
+/*
+ * mm_heap_digest - Hash of every block (address, size, allocated bit) of h
+ *                  and of the free list order. Two replays of one trace
+ *                  made the same decisions iff their digests match.
+ */
+unsigned long long mm_heap_digest(mm_heap_t *h)
+{
+    unsigned long long hash = 14695981039346656037ULL;   /* FNV-1a offset basis */
+    char *bp;
+    int i;
+
+    for( bp = h->heap_listp + 2*OVERHEAD; GET_SIZE( HDRP( bp ) ) > 0; bp = NEXT_BLKP( bp ) ) {
+        hash = digest_word( hash, (size_t)bp );
+        hash = digest_word( hash, GET( HDRP( bp ) ) );
+    }
+    for( i = 0; i < h->nsegs; i++ )
+        for( bp = h->segs[i].base + SEGOVERHEAD; GET_SIZE( HDRP( bp ) ) > 0; bp = NEXT_BLKP( bp ) ) {
+            hash = digest_word( hash, (size_t)bp );
+            hash = digest_word( hash, GET( HDRP( bp ) ) );
+        }
+    for( bp = h->free_listp; GET_ALLOC( HDRP( bp ) ) == 0; bp = NEXT_FREE( bp ) )
+        hash = digest_word( hash, (size_t)bp );
+    return hash;
+}
+
+/*
+ * mm_configure - Change the placement and growth policy of the default heap
+ */
+int mm_configure(const struct mm_config *cfg)
+{
+    return mm_heap_configure( &default_heap, cfg );
+}
+
+/*
+ * mm_heap_configure - Change the placement and growth policy of h. Takes
+ *                     effect from the next operation; blocks already in
+ *                     the heap are left as they are, except that the
+ *                     pending bin is swept if it exceeds the new defer
+ *                     and the free list is relinked in the new order.
+ *                     A zero chunksize or split means the default.
+ *                     Address order raises split to TREE_MIN, and can
+ *                     only be turned on while no listed block is smaller.
+ *                     Lifetime arenas already made get the same policy.
+ */
+int mm_heap_configure(mm_heap_t *h, const struct mm_config *cfg)
+{
+    int i;
+
+    if( cfg->fit != MM_FIT_FIRST && cfg->fit != MM_FIT_BEST && cfg->fit != MM_FIT_NEXT )
+        return -1;
+    if( cfg->split && cfg->split < OVERHEAD )
+        return -1;  /* a smaller remainder could not hold its links */
+    if( cfg->classes < 0 )
+        return -1;
+    if( cfg->order != MM_ORDER_LIFO && cfg->order != MM_ORDER_ADDRESS )
+        return -1;
+    if( !can_configure( h, cfg ) )
+        return -1;
+    for( i = 0; i < NARENAS; i++ )
+        if( h->arena[i] && !can_configure( h->arena[i], cfg ) )
+            return -1;
+    apply_config( h, cfg );
+    for( i = 0; i < NARENAS; i++ )
+        if( h->arena[i] )
+            apply_config( h->arena[i], cfg );
+    return 0;
+}
+
+/*
+ * can_configure - Whether the free list of h can take the order cfg asks
+ *                 for: address order needs room for the tree links in
+ *                 every block already listed
+ */
+static int can_configure(mm_heap_t *h, const struct mm_config *cfg)
+{
+    char *bp;
+
+    if( cfg->order == MM_ORDER_ADDRESS && h->cfg.order != MM_ORDER_ADDRESS )
+        for( bp = h->free_listp; GET_ALLOC( HDRP( bp ) ) == 0; bp = NEXT_FREE( bp ) )
+            if( GET_SIZE( HDRP( bp ) ) < TREE_MIN )
+                return 0;
+    return 1;
+}
+
+/*
+ * apply_config - Switch h to the checked policy cfg
+ */
+static void apply_config(mm_heap_t *h, const struct mm_config *cfg)
+{
+    int order = h->cfg.order;
+
+    h->cfg = *cfg;
+    if( !h->cfg.chunksize )
+        h->cfg.chunksize = CHUNKSIZE;
+    if( !h->cfg.split )
+        h->cfg.split = OVERHEAD;
+    h->cfg.split = MAX( h->cfg.split, MIN_FREE( h ) );
+    if( h->cfg.order != order )
+        reorder_free_list( h );
+    if( h->npending > h->cfg.defer )
+        sweep_pending( h );     /* the bin no longer fits */
+}
+
+/*
+ * mm_heap_get_config - Current placement and growth policy of h
+ */
+void mm_heap_get_config(mm_heap_t *h, struct mm_config *cfg)
+{
+    *cfg = h->cfg;
+}
+
+/*
+ * mm_usable_size - Bytes of payload the block at ptr can hold, at least
+ *                  what was asked for; realloc within it never moves
+ */
+size_t mm_usable_size(void *ptr)
+{
+    if( !ptr )
+        return 0;
+    return GET_SIZE( HDRP( ptr ) ) - DSIZE;
+}
+
+/*
+ * mm_malloc_size_hint - Usable size mm_malloc( size ) is sure to give
+ */
+size_t mm_malloc_size_hint(size_t size)
+{
+    return mm_heap_malloc_size_hint( &default_heap, size );
+}
+
+/*
+ * mm_heap_malloc_size_hint - Usable size mm_heap_malloc( h, size ) is sure
+ *                            to give; it can be more when the block it
+ *                            finds is too small to split
+ */
+size_t mm_heap_malloc_size_hint(mm_heap_t *h, size_t size)
+{
+    if( size <= 0 )
+        return 0;
+    return adjust_size( h, size ) - DSIZE;
+}
+
+/*
+ * mm_stats - Size and fragmentation figures for the default heap
+ */
+void mm_stats(struct mm_stats *st)
+{
+    mm_heap_stats( &default_heap, st );
+}
+
+/*
+ * mm_heap_stats - Size and fragmentation figures for h. The payload
+ *                 figures are only tracked by the simulation build.
+ */
+void mm_heap_stats(mm_heap_t *h, struct mm_stats *st)
+{
+    int i;
+
+    memset( st, 0, sizeof( *st ) );
+    heap_stats( h, st );
+    if( !h->arena[ARENA_SHORT] && !h->arena[ARENA_LONG] )
+        return;
+    for( i = 0; i < NARENAS; i++ )
+        if( h->arena[i] )
+            heap_stats( h->arena[i], st );
+    st->peak_heapsize = MAX( h->arena_peak, st->heapsize );
+}
+
+/*
+ * heap_stats - Add the figures of h alone to st
+ */
+static void heap_stats(mm_heap_t *h, struct mm_stats *st)
+{
+    char *bp;
+    size_t size = heap_size( h );
+
+    st->heapsize += size;
+    st->peak_heapsize += MAX( h->peak, size );
+    for( bp = h->free_listp; GET_ALLOC( HDRP( bp ) ) == 0; bp = NEXT_FREE( bp ) ) {
+        st->free_bytes += GET_SIZE( HDRP( bp ) );
+        st->free_blocks++;
+        st->largest_free = MAX( st->largest_free, GET_SIZE( HDRP( bp ) ) );
+    }
+    if( h->top ) {
+        st->free_bytes += GET_SIZE( HDRP( h->top ) );
+        st->free_blocks++;
+        st->largest_free = MAX( st->largest_free, GET_SIZE( HDRP( h->top ) ) );
+    }
+    for( bp = h->pending; bp; bp = NEXT_FREE( bp ) ) {
+        /* not merged yet, so each counts on its own */
+        st->free_bytes += GET_SIZE( HDRP( bp ) );
+        st->free_blocks++;
+        st->largest_free = MAX( st->largest_free, GET_SIZE( HDRP( bp ) ) );
+    }
+#ifdef MM_SIM
+    st->payload += h->payload;
+    st->peak_payload += h->peak_payload;
+#endif
+}
+
+/*
+ * mm_heap_checkheap - Check heap h for consistency
+ */
+int mm_heap_checkheap(mm_heap_t *h)
+{
+    void *bp = h->heap_listp;
+    printf("Heap (%p): \n", h->heap_listp);//prints address of heap
+
+    if((GET_SIZE(HDRP(h->heap_listp)) != OVERHEAD) || !GET_ALLOC(HDRP(h->heap_listp)))//If first block header size wrong
+    {
+        printf("Bad prologue header\n");
+        return 0;
+    }
+    if(check_block(h, h->heap_listp) == 0)//check block
+        return 0;
+
+    for(bp = h->free_listp; GET_ALLOC(HDRP(bp)) == 0; bp = NEXT_FREE(bp))//goes through all of blocks in free list
+    {
+         if(check_block(h, bp) == 0)//if block is not good
+                return 0;
+    }
+    if( h->top && ( GET_ALLOC( HDRP( h->top ) ) || GET( HDRP( h->top ) ) != GET( FTRP( h->top ) ) ||
+                    NEXT_BLKP( h->top ) != (char *)heap_hi( h ) + 1 ) ) {
+        printf("Bad top chunk\n");
+        return 0;
+    }
+    for(bp = h->pending; bp; bp = NEXT_FREE(bp))//blocks waiting for a sweep
+    {
+        if(GET(HDRP(bp)) != (GET_SIZE(HDRP(bp)) | PENDING | 1) || GET(HDRP(bp)) != GET(FTRP(bp)))
+        {
+            printf("Bad pending block %p\n", bp);
+            return 0;
+        }
+    }
+    return 1;//block is good
+}
+
+/* The remaining routines are internal helper routines */
+
+/*
+ * heap_init - Lay out the prologue and epilogue of h and give it a first chunk
+ */
+static int heap_init(mm_heap_t *h)
+{
+    char *heap_listp;
+
+    h->cfg.fit = MM_FIT_FIRST;
+    h->cfg.chunksize = CHUNKSIZE;
+    h->cfg.split = OVERHEAD;
+    h->cfg.classes = 0;
+    h->cfg.defer = 0;
+    h->cfg.order = MM_ORDER_LIFO;
+
+    /* create the initial empty heap */
+    if( ( heap_listp = heap_sbrk( h, 2*OVERHEAD ) ) == (void *)-1 )
+        return -1;
+    PUT_PAD( heap_listp );                       /* alignment padding */
+    PUT( heap_listp+WSIZE, PACK( OVERHEAD, 1 ) );  /* prologue header */
+    PUT( heap_listp + DSIZE + WSIZE, 0);    //next pointer
+    PUT( heap_listp + DSIZE, 0);            //previous pointer
+    PUT( heap_listp+DSIZE, PACK( OVERHEAD, 1 ) );  /* prologue footer */
+    PUT( heap_listp+WSIZE+DSIZE, PACK( 0, 1 ) );   /* epilogue header */
+    PUT( heap_listp + 2*OVERHEAD - DSIZE, 0 );   /* no footer before the first chunk */
+    h->heap_listp = heap_listp;
+    h->free_listp = heap_listp + DSIZE; //initializes free list pointer as heap_listp plus double word size
+    h->top = NULL;
+    h->maxfree = 0;
+    h->pending = NULL;
+    h->npending = 0;
+    h->tree = NULL;
+    h->rover = NULL;
+
+    /* Extend the empty heap with a free block of CHUNKSIZE bytes */
+    if( extend_heap( h, CHUNKSIZE/WSIZE ) == NULL )
+        return -1;
+    return 0;
+}
+
+/*
+ * map_area - Map a main area for maxsize bytes of heap and lay out an
+ *            empty heap in it. If *hp is NULL the handle is placed at
+ *            the start of the area and returned through *hp as well.
+ *            A segmented heap only maps a small home area here and
+ *            takes maxsize as the limit on its segments instead.
+ *            A non-NULL addr pins the area, and the segments after it.
+ *            No area is larger than MAXEXTENT, so that a block spanning
+ *            all of it still fits the size field of a tag word.
+ */
+static void *map_area(mm_heap_t **hp, char *addr, size_t maxsize, unsigned flags)
+{
+    size_t pagesize = heap_pagesize( flags );
+    size_t hsize = *hp ? 0 : ALIGN( sizeof( mm_heap_t ) );
+    size_t len;
+    char *base;
+    mm_heap_t *h;
+
+    if( !( flags & MM_HEAP_SEGMENTED ) && maxsize > MAXEXTENT )
+        return NULL;
+
+    /* round up so the handle, the prologue and a first chunk all fit */
+    len = hsize + 2*OVERHEAD + CHUNKSIZE;
+    if( !( flags & MM_HEAP_SEGMENTED ) )
+        len += maxsize;
+    len = PAGE_ROUND( len, pagesize );
+    if( len > MAXEXTENT )
+        len = MAXEXTENT;
+
+    base = map_pages( addr, len, ( flags & MM_HEAP_RESERVE ) ? PROT_NONE : PROT_READ | PROT_WRITE, flags );
+    if( base == MAP_FAILED )
+        return NULL;
+    if( ( flags & MM_HEAP_RESERVE ) && hsize &&
+        mprotect( base, PAGE_ROUND( hsize, pagesize ), PROT_READ | PROT_WRITE ) == -1 ) {
+        munmap( base, len );
+        return NULL;
+    }
+
+    /* the handle lives at the start of its own region */
+    h = *hp ? *hp : (mm_heap_t *)base;
+    h->backend = ( flags & MM_HEAP_RESERVE ) ? &reserve_backend : &region_backend;
+    h->map = base;
+    h->lo = base + hsize;
+    h->brk = h->lo;
+    h->end = base + len;
+    h->committed = base + PAGE_ROUND( hsize, pagesize );
+    h->flags = ( flags & ( MM_HEAP_SEGMENTED | MM_HEAP_RESERVE | MM_HEAP_HUGEPAGE ) ) | HEAP_MAPPED;
+    h->maxmapped = ( flags & MM_HEAP_SEGMENTED ) ? maxsize : 0;
+    if( addr ) {
+        h->flags |= HEAP_FIXED;
+        h->seg_next = h->end;
+    }
+    if( heap_init( h ) == -1 ) {
+        page_map_set( base, base + len, NULL );
+        OOB_CLEAR( base, base + len );
+        munmap( base, len );
+        return NULL;
+    }
+    *hp = h;
+    return h;
+}
+
+/*
+ * map_pages - Map len bytes of anonymous memory, at exactly addr if that
+ *             is not NULL. For huge page heaps the mapping is aligned to
+ *             HUGESIZE by mapping more than needed and cutting off the
+ *             slack (a fixed addr must be aligned by the caller), and
+ *             accessible mappings are marked for transparent huge pages.
+ */
+static char *map_pages(char *addr, size_t len, int prot, unsigned flags)
+{
+    char *base, *start;
+
+    if( addr ) {
+        start = mmap( addr, len, prot, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED_NOREPLACE, -1, 0 );
+        if( start != addr ) {
+            /* taken: failing beats silently landing somewhere else */
+            if( start != MAP_FAILED )
+                munmap( start, len );
+            return MAP_FAILED;
+        }
+    }
+    else if( !( flags & MM_HEAP_HUGEPAGE ) )
+        return mmap( NULL, len, prot, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0 );
+    else {
+        base = mmap( NULL, len + HUGESIZE, prot, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0 );
+        if( base == MAP_FAILED )
+            return MAP_FAILED;
+        start = (char *)PAGE_ROUND( (size_t)base, HUGESIZE );
+        if( start > base )
+            munmap( base, start - base );
+        munmap( start + len, base + HUGESIZE - start );
+    }
+#ifdef MADV_HUGEPAGE
+    if( ( flags & MM_HEAP_HUGEPAGE ) && prot != PROT_NONE )
+        madvise( start, len, MADV_HUGEPAGE );
+#endif
+    return start;
+}
+
+/*
+ * heap_pagesize - Unit in which a heap with these flags maps, commits
+ *                 and releases memory
+ */
+static size_t heap_pagesize(unsigned flags)
+{
+    return ( flags & MM_HEAP_HUGEPAGE ) ? HUGESIZE : mem_pagesize();
+}
+
+#ifndef MM_SIM
+/*
+ * touch_pages - Fault in every page of [lo, hi) by writing back one byte
+ *               per page. The bytes keep their value, so this is safe on
+ *               free blocks whose payload holds list links.
+ */
+static void touch_pages(char *lo, char *hi)
+{
+    size_t pagesize = mem_pagesize();
+    volatile char *p;
+
+    for( p = lo; p < (volatile char *)hi; p = (char *)( ( (size_t)p & ~( pagesize-1 ) ) + pagesize ) )
+        *p = *p;
+}
+#endif
+
+/*
+ * heap_checkpoint - Write the extents of h to path behind a struct mm_ckpt.
+ *                   Buffer heaps and heaps with caller regions are refused
+ *                   since their memory cannot be mapped back. The file is
+ *                   written under a temporary name and renamed over path,
+ *                   so a heap restored from path, which maps the old
+ *                   file, can be checkpointed to it again.
+ */
+static int heap_checkpoint(mm_heap_t *h, const char *path)
+{
+    static const char zero[4096];
+    struct mm_ckpt ck;
+    size_t pagesize = mem_pagesize();
+    size_t off, pad;
+    char tmp[4096];
+    FILE *fp;
+    int i, fd;
+
+#if defined(MM_SIM) || defined(MM_OOB)
+    return -1;  /* the heap holds no metadata to save */
+#endif
+    for( i = 0; i < NARENAS; i++ )
+        if( h->arena[i] )
+            return -1;  /* lifetime arenas are heaps of their own */
+    if( h->predict )
+        return -1;
+    memset( &ck, 0, sizeof( ck ) );
+    ck.magic = CKPT_MAGIC;
+    ck.inside = ( h != &default_heap );
+    ck.heap = *h;
+    if( h->backend == &memlib_backend ) {
+        ck.ext[0].base = mem_heap_lo();
+        ck.ext[0].len = mem_heapsize();
+    }
+    else if( h->flags & HEAP_MAPPED ) {
+        ck.ext[0].base = h->map;
+        ck.ext[0].len = h->brk - h->map;
+    }
+    else
+        return -1;
+    ck.next = 1;
+    for( i = 0; i < h->nsegs; i++ ) {
+        if( !( h->segs[i].flags & SEG_MAPPED ) )
+            return -1;
+        ck.ext[ck.next++] = h->segs[i];
+    }
+
+    if( snprintf( tmp, sizeof( tmp ), "%s.XXXXXX", path ) >= (int)sizeof( tmp ) ||
+        ( fd = mkstemp( tmp ) ) == -1 )
+        return -1;
+    if( ( fp = fdopen( fd, "wb" ) ) == NULL ) {
+        close( fd );
+        unlink( tmp );
+        return -1;
+    }
+    off = PAGE_ROUND( sizeof( ck ), pagesize );
+    if( fwrite( &ck, sizeof( ck ), 1, fp ) != 1 )
+        goto fail;
+    for( pad = off - sizeof( ck ); pad; pad -= MIN( pad, sizeof( zero ) ) )
+        if( fwrite( zero, MIN( pad, sizeof( zero ) ), 1, fp ) != 1 )
+            goto fail;
+    for( i = 0; i < ck.next; i++ ) {
+        if( ck.ext[i].len && fwrite( ck.ext[i].base, ck.ext[i].len, 1, fp ) != 1 )
+            goto fail;
+        for( pad = PAGE_ROUND( ck.ext[i].len, pagesize ) - ck.ext[i].len; pad; pad -= MIN( pad, sizeof( zero ) ) )
+            if( fwrite( zero, MIN( pad, sizeof( zero ) ), 1, fp ) != 1 )
+                goto fail;
+    }
+    if( fclose( fp ) != 0 || rename( tmp, path ) == -1 ) {
+        unlink( tmp );
+        return -1;
+    }
+    return 0;
+
+ fail:
+    fclose( fp );
+    unlink( tmp );
+    return -1;
+}
+
+/*
+ * heap_restore - Bring back a checkpoint into the default heap (h) or, with
+ *                h NULL, as the heap whose handle is in its main area.
+ *                Mapped heaps are mapped copy-on-write from the file, so
+ *                only the pages that get touched are ever read. Whatever
+ *                can be checked is checked before h is given up.
+ */
+static mm_heap_t *heap_restore(mm_heap_t *h, const char *path)
+{
+    struct mm_ckpt ck;
+    struct stat sb;
+    size_t pagesize = mem_pagesize();
+    size_t off, need, len;
+    char *base, *image;
+    FILE *fp;
+    int i;
+
+#if defined(MM_SIM) || defined(MM_OOB)
+    return NULL;    /* checkpoints hold in-band metadata only */
+#endif
+    if( ( fp = fopen( path, "rb" ) ) == NULL )
+        return NULL;
+    if( fread( &ck, sizeof( ck ), 1, fp ) != 1 || ck.magic != CKPT_MAGIC ||
+        ck.inside != ( h == NULL ) || ck.next < 1 || ck.next > MAXSEGS+1 ||
+        fstat( fileno( fp ), &sb ) == -1 ) {
+        fclose( fp );
+        return NULL;
+    }
+    off = PAGE_ROUND( sizeof( ck ), pagesize );
+
+    /* the file must hold every extent, and each must have room to go back */
+    need = off;
+    for( i = 0; i < ck.next; i++ ) {
+        need += PAGE_ROUND( ck.ext[i].len, pagesize );
+        if( ( ck.heap.flags & HEAP_MAPPED ) &&
+            !restore_room( h, i ? ck.ext[i].base : ck.heap.map,
+                           i ? ck.ext[i].len : (size_t)( ck.heap.end - ck.heap.map ) ) )
+            goto fail;
+    }
+    if( (size_t)sb.st_size < need ||
+        ( ( ck.heap.flags & HEAP_MAPPED ) && ck.ext[0].len > (size_t)( ck.heap.end - ck.heap.map ) ) )
+        goto fail;
+
+    if( !( ck.heap.flags & HEAP_MAPPED ) ) {
+        /* memlib heap: only possible if memlib sits where it did before */
+        if( ck.next != 1 || mem_heap_lo() != (void *)ck.ext[0].base )
+            goto fail;
+        /* read the image aside, and grow memlib to its size, while h still stands */
+        len = ck.ext[0].len;
+        if( !len )
+            image = NULL;
+        else if( ( image = mmap( NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 ) ) == MAP_FAILED )
+            goto fail;
+        if( ( len && ( fseek( fp, off, SEEK_SET ) == -1 || fread( image, len, 1, fp ) != 1 ) ) ||
+            ( len > mem_heapsize() && mem_sbrk( len - mem_heapsize() ) == (void *)-1 ) ) {
+            if( image )
+                munmap( image, len );
+            goto fail;
+        }
+        fclose( fp );
+        heap_release( h );
+        mem_reset_brk();
+        mem_sbrk( len );    /* cannot fail: the break has been this far */
+        if( image ) {
+            memcpy( ck.ext[0].base, image, len );
+            munmap( image, len );
+        }
+        *h = ck.heap;
+        h->backend = &memlib_backend;
+        return h;
+    }
+
+    if( h )
+        heap_release( h );
+    if( restore_area( &ck, fileno( fp ), off ) == -1 )
+        goto lost;
+    off += PAGE_ROUND( ck.ext[0].len, pagesize );
+    for( i = 1; i < ck.next; i++ ) {
+        base = mmap( ck.ext[i].base, ck.ext[i].len, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_FIXED_NOREPLACE, fileno( fp ), off );
+        if( base != ck.ext[i].base ) {
+            if( base != MAP_FAILED )
+                munmap( base, ck.ext[i].len );
+            while( --i > 0 )
+                munmap( ck.ext[i].base, ck.ext[i].len );
+            munmap( ck.heap.map, ck.heap.end - ck.heap.map );
+            goto lost;
+        }
+        off += PAGE_ROUND( ck.ext[i].len, pagesize );
+    }
+    fclose( fp );
+
+    /* the handle either sits in the main area or goes back into h */
+    if( h )
+        *h = ck.heap;
+    else
+        h = (mm_heap_t *)ck.heap.map;
+    h->backend = ( h->flags & MM_HEAP_RESERVE ) ? &reserve_backend : &region_backend;
+    if( page_map_set( h->map, h->brk, h ) == -1 )
+        goto unmap;
+    for( i = 0; i < h->nsegs; i++ )
+        if( page_map_set( h->segs[i].base, h->segs[i].base + h->segs[i].len, h ) == -1 )
+            goto unmap;
+    return h;
+
+ unmap:
+    heap_release( h );
+    if( !ck.inside ) {
+        memset( h, 0, sizeof( *h ) );
+        h->backend = &memlib_backend;
+    }
+    return NULL;
+
+ lost:
+    /* the address space changed under us after the checks: h is gone */
+    if( h ) {
+        memset( h, 0, sizeof( *h ) );
+        h->backend = &memlib_backend;
+    }
+ fail:
+    fclose( fp );
+    return NULL;
+}
+
+/*
+ * restore_room - Whether the len bytes at base can be mapped once h (if
+ *                not NULL) is released: nothing is mapped there now, or
+ *                it lies in one mapping of h
+ */
+static int restore_room(mm_heap_t *h, char *base, size_t len)
+{
+    char *p;
+    int i;
+
+    if( !len )
+        return 1;
+    if( h && ( h->flags & HEAP_MAPPED ) && base >= h->map && base + len <= h->end )
+        return 1;
+    for( i = 0; h && i < h->nsegs; i++ )
+        if( ( h->segs[i].flags & SEG_MAPPED ) && base >= h->segs[i].base &&
+            base + len <= h->segs[i].base + h->segs[i].len )
+            return 1;
+    p = mmap( base, len, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED_NOREPLACE, -1, 0 );
+    if( p != MAP_FAILED )
+        munmap( p, len );
+    return p == base;
+}
+
+/*
+ * restore_area - Map the main area of a checkpoint back: the whole range
+ *                as it was reserved, with the saved image on top of it
+ */
+static int restore_area(struct mm_ckpt *ck, int fd, size_t off)
+{
+    size_t pagesize = mem_pagesize();
+    size_t len = ck->heap.end - ck->heap.map;
+    size_t image = PAGE_ROUND( ck->ext[0].len, pagesize );
+    int prot = ( ck->heap.flags & MM_HEAP_RESERVE ) ? PROT_NONE : PROT_READ | PROT_WRITE;
+    char *base;
+
+    base = mmap( ck->heap.map, len, prot, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED_NOREPLACE, -1, 0 );
+    if( base != ck->heap.map ) {
+        if( base != MAP_FAILED )
+            munmap( base, len );
+        return -1;
+    }
+    if( image && mmap( base, image, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, off ) == MAP_FAILED )
+        goto fail;
+    if( ( ck->heap.flags & MM_HEAP_RESERVE ) && ck->heap.committed > base + image &&
+        mprotect( base + image, ck->heap.committed - ( base + image ), PROT_READ | PROT_WRITE ) == -1 )
+        goto fail;
+    return 0;
+
+ fail:
+    munmap( base, len );
+    return -1;
+}
+
+/*
+ * heap_size - Bytes currently spanned by the main area and the segments
+ */
+static size_t heap_size(mm_heap_t *h)
+{
+    size_t size = (char *)heap_hi( h ) + 1 - (char *)heap_lo( h );
+    int i;
+
+    for( i = 0; i < h->nsegs; i++ )
+        size += h->segs[i].len;
+    return size;
+}
+
+/*
+ * digest_word - Fold the bytes of w into an FNV-1a hash
+ */
+static unsigned long long digest_word(unsigned long long hash, size_t w)
+{
+    size_t i;
+
+    for( i = 0; i < sizeof( w ); i++ ) {
+        hash ^= ( w >> ( 8*i ) ) & 0xff;
+        hash *= 1099511628211ULL;   /* FNV-1a prime */
+    }
+    return hash;
+}
+
+/*
+ * heap_release - Unmap everything the allocator mapped for h, the main
+ *                area (and with it a handle stored there) last
+ */
+static void heap_release(mm_heap_t *h)
+{
+    int i;
+
+    for( i = 0; i < NARENAS; i++ )
+        if( h->arena[i] ) {
+            heap_release( h->arena[i] );
+            h->arena[i] = NULL;
+        }
+    mm_heap_predict( h, 0 );
+    for( i = 0; i < h->nsegs; i++ )
+        if( h->segs[i].flags & SEG_MAPPED ) {
+            page_map_set( h->segs[i].base, h->segs[i].base + h->segs[i].len, NULL );
+            OOB_CLEAR( h->segs[i].base, h->segs[i].base + h->segs[i].len );
+            munmap( h->segs[i].base, h->segs[i].len );
+        }
+    h->nsegs = 0;
+    if( h->flags & HEAP_MAPPED ) {
+        h->flags &= ~HEAP_MAPPED;
+        page_map_set( h->map, h->end, NULL );
+        OOB_CLEAR( h->map, h->end );
+        munmap( h->map, h->end - h->map );
+    }
+}
+
+/*
+ * heap_sbrk - Grow h by incr bytes and return the old break, or (void *)-1
+ */
+static void *heap_sbrk(mm_heap_t *h, size_t incr)
+{
+    char *old = h->backend->sbrk( h, incr );
+
+    /* mapped main areas are in the page map as far as they are in use */
+    if( old != (void *)-1 && ( h->flags & HEAP_MAPPED ) &&
+        page_map_set( old, old + incr, h ) == -1 ) {
+        h->brk = old;
+        return (void *)-1;
+    }
+    return old;
+}
+
+/*
+ * heap_lo, heap_hi - First and last byte currently in use by h
+ */
+static void *heap_lo(mm_heap_t *h)
+{
+    return h->backend->lo( h );
+}
+
+static void *heap_hi(mm_heap_t *h)
+{
+    return h->backend->hi( h );
+}
+
+/*
+ * memlib_sbrk, memlib_lo, memlib_hi - The classic memlib heap
+ */
+static void *memlib_sbrk(mm_heap_t *h, size_t incr)
+{
+    (void)h;    /* there is only one memlib heap */
+    if( incr > MAXEXTENT - mem_heapsize() )
+        return (void *)-1;
+    return mem_sbrk( incr );
+}
+
+static void *memlib_lo(mm_heap_t *h)
+{
+    (void)h;
+    return mem_heap_lo();
+}
+
+static void *memlib_hi(mm_heap_t *h)
+{
+    (void)h;
+    return mem_heap_hi();
+}
+
+/*
+ * region_sbrk - Bump the break within a private region
+ */
+static void *region_sbrk(mm_heap_t *h, size_t incr)
+{
+    char *old = h->brk;
+
+    if( incr > (size_t)( h->end - h->brk ) )
+        return (void *)-1;
+    h->brk += incr;
+    return old;
+}
+
+static void *region_lo(mm_heap_t *h)
+{
+    return h->lo;
+}
+
+static void *region_hi(mm_heap_t *h)
+{
+    return h->brk - 1;
+}
+
+/*
+ * reserve_sbrk - Bump the break within a reservation, committing pages
+ *                in COMMITSIZE steps (whole huge pages for huge page
+ *                heaps) as it passes the committed end
+ */
+static void *reserve_sbrk(mm_heap_t *h, size_t incr)
+{
+    char *old = h->brk;
+    char *commit;
+    size_t step = MAX( COMMITSIZE, heap_pagesize( h->flags ) );
+
+    if( incr > (size_t)( h->end - h->brk ) )
+        return (void *)-1;
+    if( h->brk + incr > h->committed ) {
+        commit = h->committed + PAGE_ROUND( (size_t)( h->brk + incr - h->committed ), step );
+        if( commit > h->end )
+            commit = h->end;
+        if( mprotect( h->committed, commit - h->committed, PROT_READ | PROT_WRITE ) == -1 )
+            return (void *)-1;
+#ifdef MADV_HUGEPAGE
+        if( h->flags & MM_HEAP_HUGEPAGE )
+            madvise( h->committed, commit - h->committed, MADV_HUGEPAGE );
+#endif
+        h->committed = commit;
+    }
+    h->brk += incr;
+    return old;
+}
+
+/*
+ * reserve_trim - Lower the break by decr bytes and decommit the whole
+ *                pages above it. Huge page heaps never split a huge page.
+ */
+static void reserve_trim(mm_heap_t *h, size_t decr)
+{
+    char *keep;
+
+    h->brk -= decr;
+    keep = (char *)PAGE_ROUND( (size_t)h->brk, heap_pagesize( h->flags ) );
+    if( keep < h->committed ) {
+        OOB_CLEAR( keep, h->committed );
+        madvise( keep, h->committed - keep, MADV_DONTNEED );
+        mprotect( keep, h->committed - keep, PROT_NONE );
+        h->committed = keep;
+    }
+}
+
+/*
+ * trim_heap - Give the tail of free block bp back to the backend if bp
+ *             is the last block of the main area and is large enough
+ */
+static void trim_heap(mm_heap_t *h, void *bp)
+{
+    size_t size = GET_SIZE( HDRP( bp ) );
+    size_t heapsize;
+    char *newbrk;
+
+    if( (char *)bp + size != h->brk || size < TRIM_THRESHOLD )
+        return;
+
+    /* keep a minimum free block and end the heap on a page boundary */
+    newbrk = (char *)PAGE_ROUND( (size_t)bp + DSIZE + OVERHEAD, mem_pagesize() );
+    if( h->reserved && ( heapsize = heap_size( h ) ) - ( h->brk - newbrk ) < h->reserved ) {
+        /* and keep what mm_heap_reserve set aside */
+        if( heapsize <= h->reserved )
+            return;
+        newbrk = (char *)PAGE_ROUND( (size_t)( h->brk - ( heapsize - h->reserved ) ), mem_pagesize() );
+    }
+    if( newbrk >= h->brk )
+        return;
+    size = newbrk - (char *)bp;
+    PUT( HDRP( bp ), PACK( size, 0 ) );
+    PUT( FTRP( bp ), PACK( size, 0 ) );
+    PUT( HDRP( NEXT_BLKP( bp ) ), PACK( 0, 1 ) );   /* new epilogue header */
+    h->backend->trim( h, h->brk - newbrk );
+}
+
+/*
+ * owner - The heap bp belongs to: h itself or one of its arenas
+ */
+static mm_heap_t *owner(mm_heap_t *h, void *bp)
+{
+    mm_heap_t *o;
+
+    if( !h->arena[ARENA_SHORT] && !h->arena[ARENA_LONG] )
+        return h;
+    o = page_owner( bp );   /* arenas are always mapped, so always in the map */
+    return o && o->parent == h ? o : h;
+}
+
+/*
+ * page_owner - Heap the page holding p was mapped for, or NULL
+ */
+static mm_heap_t *page_owner(void *p)
+{
+    size_t pn = (size_t)p >> PM_SHIFT;
+    struct pm_node *n;
+    struct pm_leaf *l;
+
+    if( PM_BEYOND( pn ) )
+        return NULL;
+    if( ( n = __atomic_load_n( &page_map[pn >> ( 2*PM_BITS )], __ATOMIC_ACQUIRE ) ) == NULL )
+        return NULL;
+    if( ( l = __atomic_load_n( &n->leaf[( pn >> PM_BITS ) & ( PM_LEN-1 )], __ATOMIC_ACQUIRE ) ) == NULL )
+        return NULL;
+    return __atomic_load_n( &l->heap[pn & ( PM_LEN-1 )], __ATOMIC_RELAXED );
+}
+
+/*
+ * page_leaf - Leaf of the page map for page number pn, installing the
+ *             nodes on the way if make is set; NULL if there is none
+ */
+static struct pm_leaf *page_leaf(size_t pn, int make)
+{
+    void **slot = (void **)&page_map[pn >> ( 2*PM_BITS )];
+    void *node, *old;
+    int level;
+
+    if( PM_BEYOND( pn ) )
+        return NULL;    /* beyond 48 bits */
+    for( level = 0; ; level++ ) {
+        if( ( node = __atomic_load_n( slot, __ATOMIC_ACQUIRE ) ) == NULL ) {
+            if( !make )
+                return NULL;
+            /* a node and a leaf have the same size */
+            node = mmap( NULL, sizeof( struct pm_leaf ), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+            if( node == MAP_FAILED )
+                return NULL;
+            old = NULL;
+            if( !__atomic_compare_exchange_n( slot, &old, node, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE ) ) {
+                munmap( node, sizeof( struct pm_leaf ) );   /* another thread was first */
+                node = old;
+            }
+        }
+        if( level == 1 )
+            return node;
+        slot = (void **)&( (struct pm_node *)node )->leaf[( pn >> PM_BITS ) & ( PM_LEN-1 )];
+    }
+}
+
+/*
+ * page_map_set - Record h as the owner of the pages from lo up to hi, or
+ *                forget them with h NULL. Fails only if a node of the
+ *                map cannot be mapped.
+ */
+static int page_map_set(char *lo, char *hi, mm_heap_t *h)
+{
+    size_t pn = (size_t)lo >> PM_SHIFT;
+    size_t end = ( (size_t)hi + ( 1 << PM_SHIFT ) - 1 ) >> PM_SHIFT;
+    struct pm_leaf *l;
+
+    while( pn < end ) {
+        if( ( l = page_leaf( pn, h != NULL ) ) == NULL ) {
+            if( h )
+                return -1;
+            pn = ( pn | ( PM_LEN-1 ) ) + 1;     /* nothing recorded in this leaf */
+            continue;
+        }
+        for( ; pn < end; pn++ ) {
+            __atomic_store_n( &l->heap[pn & ( PM_LEN-1 )], h, __ATOMIC_RELAXED );
+            if( ( pn & ( PM_LEN-1 ) ) == PM_LEN-1 ) {
+                pn++;
+                break;
+            }
+        }
+    }
+    return 0;
+}
+
+/*
+ * can_map - Whether h may map arenas and side tables of its own: not for
+ *           buffer heaps, which never map memory, nor for fixed heaps,
+ *           which must stay reproducible
+ */
+static int can_map(mm_heap_t *h)
+{
+    return ( h->backend == &memlib_backend || ( h->flags & HEAP_MAPPED ) ) &&
+           !( h->flags & HEAP_FIXED );
+}
+
+/*
+ * site_lookup - Entry for site, made if new; NULL if the table is full
+ */
+static struct mm_site *site_lookup(struct mm_predict *p, void *site)
+{
+    size_t i, n;
+
+    i = ( (size_t)site >> 2 ) * 0x9e3779b1u;
+    for( n = 0; n < NSITES; n++, i++ ) {
+        struct mm_site *s = &p->sites[i & ( NSITES-1 )];
+
+        if( s->site == site )
+            return s;
+        if( !s->site ) {
+            s->site = site;
+            return s;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * site_record - Count one sampled lifetime for a site
+ */
+static void site_record(struct mm_site *s, int long_lived)
+{
+    if( long_lived )
+        s->nlong++;
+    else
+        s->nshort++;
+    if( s->nshort + s->nlong >= SITE_MAX ) {
+        s->nshort /= 2;
+        s->nlong /= 2;
+    }
+}
+
+/*
+ * sample_slot - The one sample slot bp in h can occupy. It goes by the
+ *               offset in the heap, not the address, so that where the
+ *               heap was mapped does not change what is learned.
+ */
+static struct mm_sample *sample_slot(struct mm_predict *p, mm_heap_t *h, void *bp)
+{
+    size_t off = (char *)bp - (char *)heap_lo( h );
+
+    return &p->samples[( ( off >> 3 ) * 0x9e3779b1u >> 8 ) & ( NSAMPLES-1 )];
+}
+
+/*
+ * sample_alloc - Start watching block bp from site s, unless its slot
+ *                still watches a block younger than the threshold. An
+ *                older one is given up and counts as long-lived.
+ */
+static void sample_alloc(struct mm_predict *p, mm_heap_t *h, void *bp, struct mm_site *s)
+{
+    struct mm_sample *sp = sample_slot( p, h, bp );
+
+    if( sp->bp ) {
+        if( p->clock - sp->birth < p->lifetime )
+            return;
+        site_record( sp->site, 1 );
+    }
+    sp->bp = bp;
+    sp->site = s;
+    sp->birth = p->clock;
+}
+
+/*
+ * sample_free - Record the lifetime of bp if it was sampled
+ */
+static void sample_free(struct mm_predict *p, mm_heap_t *h, void *bp)
+{
+    struct mm_sample *sp = sample_slot( p, h, bp );
+
+    if( sp->bp != bp )
+        return;
+    site_record( sp->site, p->clock - sp->birth >= p->lifetime );
+    sp->bp = NULL;
+}
+
+/*
+ * arena_peak - Track the combined size of h and its arenas after an
+ *              allocation may have grown one of them
+ */
+static void arena_peak(mm_heap_t *h)
+{
+    size_t size = heap_size( h );
+    int i;
+
+    for( i = 0; i < NARENAS; i++ )
+        if( h->arena[i] )
+            size += heap_size( h->arena[i] );
+    h->arena_peak = MAX( h->arena_peak, size );
+}
+
+/*
+ * in_heap - Return nonzero if p lies in h's main area or a chained region
+ */
+static int in_heap(mm_heap_t *h, void *p)
+{
+    int i;
+
+    if( (char *)p >= (char *)heap_lo( h ) && (char *)p <= (char *)heap_hi( h ) )
+        return 1;
+    for( i = 0; i < h->nsegs; i++ )
+        if( (char *)p >= h->segs[i].base && (char *)p < h->segs[i].base + h->segs[i].len )
+            return 1;
+    return 0;
+}
+
+/*
+ * add_segment - Lay out the len bytes at base as a region of its own
+ *               and put its body on the free list. Returns the free
+ *               block, or NULL if the region is too small or the
+ *               segment table is full.
+ *
+ *   | pad | prologue hdr | prologue ftr | free block ... | epilogue hdr |
+ */
+static void *add_segment(mm_heap_t *h, char *base, size_t len)
+{
+    char *start = (char *)ALIGN( (size_t)base );
+    char *bp;
+    size_t size;
+
+    if( h->nsegs == MAXSEGS || len < (size_t)( start - base ) + SEGOVERHEAD + DSIZE + OVERHEAD )
+        return NULL;
+    len = MIN( len - ( start - base ), MAXEXTENT ) & ~0x7;
+    size = len - SEGOVERHEAD;
+
+    PUT_PAD( start );                                /* alignment padding */
+    PUT( start + WSIZE, PACK( DSIZE, 1 ) );          /* prologue header */
+    PUT( start + DSIZE, PACK( DSIZE, 1 ) );          /* prologue footer */
+    bp = start + SEGOVERHEAD;
+    PUT( HDRP( bp ), PACK( size, 0 ) );              /* free block header */
+    PUT( FTRP( bp ), PACK( size, 0 ) );              /* free block footer */
+    PUT( HDRP( NEXT_BLKP( bp ) ), PACK( 0, 1 ) );    /* epilogue header */
+
+    h->segs[h->nsegs].base = start;
+    h->segs[h->nsegs].len = len;
+    h->segs[h->nsegs].flags = 0;
+    h->nsegs++;
+    return coalesce( h, bp );
+}
+
+/*
+ * map_segment - Map a new segment with room for a free block of at least
+ *               size bytes. Segments grow with the heap so the table
+ *               stays small even for very large heaps.
+ */
+static void *map_segment(mm_heap_t *h, size_t size)
+{
+    size_t pagesize = heap_pagesize( h->flags );
+    size_t len;
+    char *base;
+    void *bp;
+
+    if( size > MAXEXTENT - SEGOVERHEAD - pagesize )
+        return NULL;
+    len = MAX( size + SEGOVERHEAD, MAX( SEGSIZE, MIN( h->mapped / 4, MAXEXTENT ) ) );
+    len = PAGE_ROUND( len, pagesize );
+    if( h->maxmapped && h->mapped + len > h->maxmapped ) {
+        /* settle for just enough if the growth step would pass the limit */
+        len = PAGE_ROUND( size + SEGOVERHEAD, pagesize );
+        if( h->mapped + len > h->maxmapped )
+            return NULL;
+    }
+    if( h->nsegs == MAXSEGS )
+        return NULL;
+
+    base = map_pages( ( h->flags & HEAP_FIXED ) ? h->seg_next : NULL, len, PROT_READ | PROT_WRITE, h->flags );
+    if( base == MAP_FAILED )
+        return NULL;
+    if( page_map_set( base, base + len, h ) == -1 || ( bp = add_segment( h, base, len ) ) == NULL ) {
+        page_map_set( base, base + len, NULL );
+        OOB_CLEAR( base, base + len );
+        munmap( base, len );
+        return NULL;
+    }
+    if( h->flags & HEAP_FIXED )
+        h->seg_next = base + len;   /* never reused, so placement stays reproducible */
+    h->peak = MAX( h->peak, heap_size( h ) );
+    h->segs[h->nsegs-1].flags = SEG_MAPPED;
+    h->mapped += len;
+    return bp;
+}
 
 /*
- * mm_init - Initialize the memory manager
+ * release_segment - Unmap the segment around free block bp if bp now
+ *                   spans its whole body. Returns nonzero if it did.
+ *                   One empty segment is kept as the spare, so a heap
+ *                   going back and forth across a segment boundary does
+ *                   not map and unmap it every time.
  */
-int mm_init(void)
+static int release_segment(mm_heap_t *h, void *bp)
 {
-    /* create the initial empty heap */
-    if( ( heap_listp = mem_sbrk( 2*OVERHEAD ) ) == NULL )
-        return -1;
-    PUT( heap_listp, 0 );                        /* alignment padding */
-    PUT( heap_listp+WSIZE, PACK( OVERHEAD, 1 ) );  /* prologue header */
-    PUT( heap_listp + DSIZE + WSIZE, 0);    //next pointer
-    PUT( heap_listp + DSIZE, 0);            //previous pointer
-    PUT( heap_listp+DSIZE, PACK( OVERHEAD, 1 ) );  /* prologue footer */
-    PUT( heap_listp+WSIZE+DSIZE, PACK( 0, 1 ) );   /* epilogue header */
-    free_listp = heap_listp + DSIZE; //initializes free list pointer as heap_listp plus double word size
+    struct mm_seg *seg;
+    char *spare;
+    int i;
 
-    /* Extend the empty heap with a free block of CHUNKSIZE bytes */
-    if( extend_heap( CHUNKSIZE/WSIZE ) == NULL )
-        return -1;
-    return 0;
+    /* cheap test first: bp must sit between a prologue and an epilogue */
+    if( GET( HDRP( bp ) - WSIZE ) != PACK( DSIZE, 1 ) ||
+        GET( HDRP( NEXT_BLKP( bp ) ) ) != PACK( 0, 1 ) )
+        return 0;
+    for( i = 0; i < h->nsegs; i++ )
+        if( h->segs[i].base + SEGOVERHEAD == (char *)bp )
+            break;
+    if( i == h->nsegs || !( h->segs[i].flags & SEG_MAPPED ) )
+        return 0;
+    if( h->reserved && heap_size( h ) - h->segs[i].len < h->reserved )
+        return 0;   /* mm_heap_reserve set it aside */
+
+    /* keep this one unless the spare is still empty */
+    spare = h->spare ? h->spare + SEGOVERHEAD : NULL;
+    if( !spare || spare == (char *)bp || GET_ALLOC( HDRP( spare ) ) ||
+        GET( HDRP( NEXT_BLKP( spare ) ) ) != PACK( 0, 1 ) ) {
+        h->spare = h->segs[i].base;
+        return 0;
+    }
 
+    seg = &h->segs[i];
+    delete_block( h, bp );
+    h->mapped -= seg->len;
+    page_map_set( seg->base, seg->base + seg->len, NULL );
+    OOB_CLEAR( seg->base, seg->base + seg->len );
+    munmap( seg->base, seg->len );
+    *seg = h->segs[--h->nsegs];
+    return 1;
 }
 
 /*
- * mm_malloc - Allocate a block with at least size bytes of payload
+ * extend_heap - Extend heap with free block and return its block pointer
  */
-void *mm_malloc(size_t size)
+static void *extend_heap(mm_heap_t *h, size_t words)
 {
-    size_t asize;      /* adjusted block size */
-    size_t extendsize; /* amount to extend heap if no fit */
     char *bp;
+    size_t size;
 
-    /* Ignore spurious requests */
-    if( size <= 0 )
-        return NULL;
+    /* Allocate an even number of words to maintain alignment */
+    size = ( words % 2 ) ? ( words+1 ) * WSIZE : words * WSIZE;
 
-    /* Adjust block size to include overhead and alignment reqs. */
-    if( size <= DSIZE )
-        asize = DSIZE + OVERHEAD;
-    else
-        asize = DSIZE * ( ( size + (OVERHEAD) + ( DSIZE-1 ) ) / DSIZE );
+    if( ( bp = heap_sbrk( h, size ) ) == (void *)-1 ) {
+        /* no room above the epilogue: carry on in a segment of its own */
+        if( h->flags & MM_HEAP_SEGMENTED )
+            return map_segment( h, size );
+        return NULL;
+    }
 
-    /* Search the free list for a fit */
-    if( ( bp = find_fit( asize ) ) != NULL ) {
-        place( bp, asize );
+    /* new space right after the top chunk only makes it longer */
+    if( h->top && NEXT_BLKP( h->top ) == bp ) {
+        bp = h->top;
+        size += GET_SIZE( HDRP( bp ) );
+        PUT( HDRP( bp ), PACK( size, 0 ) );
+        PUT( FTRP( bp ), PACK( size, 0 ) );
+        PUT( HDRP( NEXT_BLKP( bp ) ), PACK( 0, 1 ) );
+        h->peak = MAX( h->peak, heap_size( h ) );
         return bp;
     }
 
-    /* No fit found. Get more memory and place the block */
-    extendsize = MAX( asize, CHUNKSIZE );
-    if( ( bp = extend_heap( extendsize/WSIZE ) ) == NULL )
-        return NULL;
-    place( bp, asize );
-    return bp;
+    /* Initialize free block header/footer and the epilogue header */
+    PUT( HDRP( bp ), PACK( size, 0 ) );         /* free block header */
+    PUT( FTRP( bp ), PACK( size, 0 ) );         /* free block footer */
+    PUT( HDRP( NEXT_BLKP( bp ) ), PACK( 0, 1 ) ); /* new epilogue header */
+    h->peak = MAX( h->peak, heap_size( h ) );
+
+    /* Coalesce if the previous block was free */
+    return coalesce( h, bp );
 }
 
 /*
- * mm_free - Free a block
+ * alloc_block - Allocated block of asize bytes, from the free list, else
+ *               from the top chunk, else from new memory; NULL if the
+ *               heap cannot grow
  */
-void mm_free(void *bp)
+static void *alloc_block(mm_heap_t *h, size_t asize)
 {
-    if(!bp)
-      return;
-
-    size_t size = GET_SIZE( HDRP( bp ) );
+    size_t extendsize; /* amount to extend heap if no fit */
+    char *bp;
 
-    PUT( HDRP( bp ), PACK( size, 0 ) );
-    PUT( FTRP( bp ), PACK( size, 0 ) );
-    coalesce( bp );
+    /* Search the free list for a fit; headroom only goes before new memory */
+    bp = asize <= h->maxfree ? find_fit( h, asize ) : NULL;
+    if( ( !bp || GET_TAG( HDRP( bp ) ) ) && h->pending ) {
+        /* the pending bin may hold what is missing */
+        sweep_pending( h );
+        bp = asize <= h->maxfree ? find_fit( h, asize ) : NULL;
+    }
+    if( bp && !GET_TAG( HDRP( bp ) ) ) {
+        place( h, bp, asize );
+        return bp;
+    }
+    if( h->top && GET_SIZE( HDRP( h->top ) ) >= asize )
+        return bump_top( h, asize );
+    if( bp == NULL ) {
+        /* No fit found. Get more memory */
+        extendsize = MAX( asize, h->cfg.chunksize );
+        if( ( bp = extend_heap( h, extendsize/WSIZE ) ) == NULL )
+            return NULL;
+        if( bp == h->top )
+            return bump_top( h, asize );
+    }
+    place( h, bp, asize );
+    return bp;
 }
 
 /*
- * mm_realloc - naive implementation of mm_realloc
+ * bump_top - Carve an allocated block of asize bytes off the front of the
+ *            top chunk, which must hold it. The rest stays the top chunk,
+ *            so nothing is searched, linked or coalesced.
  */
-void *mm_realloc(void *ptr, size_t size)
+static void *bump_top(mm_heap_t *h, size_t asize)
 {
+    char *bp = h->top;
+    size_t csize = GET_SIZE( HDRP( bp ) );
 
-    void *newp;
-    size_t copySize;
-
-
-    if( ( newp = mm_malloc( size ) ) == NULL ) {
-        printf( "ERROR: mm_malloc failed in mm_realloc\n" );
-        exit( 1 );
+    if( ( csize - asize ) < h->cfg.split ) {
+        PUT( HDRP( bp ), PACK( csize, 1 ) );
+        PUT( FTRP( bp ), PACK( csize, 1 ) );
+        h->top = NULL;
+        return bp;
     }
-    copySize = GET_SIZE( HDRP( ptr ) );
-    if( size < copySize )
-        copySize = size;
-    memcpy( newp, ptr, copySize );
-    mm_free( ptr );
-    return newp;
+    PUT( HDRP( bp ), PACK( asize, 1 ) );
+    PUT( FTRP( bp ), PACK( asize, 1 ) );
+    h->top = NEXT_BLKP( bp );
+    PUT( HDRP( h->top ), PACK( csize-asize, 0 ) );
+    PUT( FTRP( h->top ), PACK( csize-asize, 0 ) );
+    return bp;
 }
 
 /*
- * mm_checkheap - Check the heap for consistency
+ * grow_block - Grow allocated block bp in place to asize bytes by taking
+ *              in the free block after it, extending the heap first if bp
+ *              is last. A block that has grown before keeps the rest of
+ *              that free block, or half of asize extra when extending, as
+ *              HEADROOM. Returns 0 if bp cannot grow where it is.
  */
-int mm_checkheap(void)
+static int grow_block(mm_heap_t *h, void *bp, size_t asize)
 {
-    void *bp = heap_listp;
-    printf("Heap (%p): \n", heap_listp);//prints address of heap
+    size_t csize = GET_SIZE( HDRP( bp ) );
+    size_t grown = GET_TAG( HDRP( bp ) );
+    char *next = NEXT_BLKP( bp );
+    size_t room;
 
-    if((GET_SIZE(HDRP(heap_listp)) != OVERHEAD) || !GET_ALLOC(HDRP(heap_listp)))//If first block header size wrong
-    {
-        printf("Bad prologue header\n");
-        return 0;
+    /* last block of the main area, or below a short top chunk: make the room above it */
+    if( next == (char *)heap_hi( h ) + 1 ||
+        ( next == h->top && csize + GET_SIZE( HDRP( next ) ) < asize ) ) {
+        room = asize - csize + ( grown ? asize/2 : 0 );
+        if( next == h->top )
+            room -= GET_SIZE( HDRP( next ) );
+        if( extend_heap( h, MAX( room, h->cfg.chunksize ) / WSIZE ) == NULL )
+            return 0;
     }
-    if(check_block(heap_listp) == 0)//check block
+    if( GET_ALLOC( HDRP( next ) ) || csize + GET_SIZE( HDRP( next ) ) < asize )
         return 0;
 
-    for(bp = free_listp; GET_ALLOC(HDRP(bp)) == 0; bp = NEXT_FREE(bp))//goes through all of blocks in free list
-    {
-         if(check_block(bp) == 0)//if block is not good
-                return 0;
+    room = csize + GET_SIZE( HDRP( next ) );
+    delete_block( h, next );
+    if( ( room - asize ) >= h->cfg.split ) {
+        PUT( HDRP( bp ), PACK( asize, 1 ) | GROWN );
+        PUT( FTRP( bp ), PACK( asize, 1 ) | GROWN );
+        next = NEXT_BLKP( bp );
+        /* the old successor was free, so the block after it is allocated */
+        PUT( HDRP( next ), PACK( room-asize, 0 ) | grown );
+        PUT( FTRP( next ), PACK( room-asize, 0 ) | grown );
+        freelist( h, next );
     }
-    return 1;//block is good
+    else {
+        PUT( HDRP( bp ), PACK( room, 1 ) | GROWN );
+        PUT( FTRP( bp ), PACK( room, 1 ) | GROWN );
+    }
+    return 1;
 }
 
-/* The remaining routines are internal helper routines */
+/*
+ * shrink_block - Cut allocated block bp down to asize bytes and free the
+ *                tail, if the tail is at least the split threshold
+ */
+static void shrink_block(mm_heap_t *h, void *bp, size_t asize)
+{
+    size_t csize = GET_SIZE( HDRP( bp ) );
+    size_t tag = GET_TAG( HDRP( bp ) );
+
+    if( ( csize - asize ) < h->cfg.split )
+        return;
+    PUT( HDRP( bp ), PACK( asize, 1 ) | tag );
+    PUT( FTRP( bp ), PACK( asize, 1 ) | tag );
+    bp = NEXT_BLKP( bp );
+    PUT( HDRP( bp ), PACK( csize-asize, 0 ) );
+    PUT( FTRP( bp ), PACK( csize-asize, 0 ) );
+    coalesce( h, bp );
+}
 
 /*
- * extend_heap - Extend heap with free block and return its block pointer
+ * alloc_congruent - Allocated block of asize bytes whose payload starts at
+ *                   the same offset within a page as ptr, so whole pages
+ *                   of ptr can be remapped into it. The slack in front is
+ *                   freed again. NULL if there is no room for the slack.
  */
-static void *extend_heap( size_t words )
+static void *alloc_congruent(mm_heap_t *h, size_t asize, char *ptr)
 {
+    size_t pagesize = mem_pagesize();
+    size_t csize, d;
     char *bp;
-    size_t size;
 
-    /* Allocate an even number of words to maintain alignment */
-    size = ( words % 2 ) ? ( words+1 ) * WSIZE : words * WSIZE;
+    if( ( bp = alloc_block( h, asize + pagesize + MIN_FREE( h ) ) ) == NULL )
+        return NULL;
+    d = ( ptr - bp ) & ( pagesize-1 );
+    if( d && d < MIN_FREE( h ) )
+        d += pagesize;  /* the slack must hold a free block of its own */
+    if( d ) {
+        csize = GET_SIZE( HDRP( bp ) );
+        PUT( HDRP( bp ), PACK( d, 0 ) );
+        PUT( FTRP( bp ), PACK( d, 0 ) );
+        PUT( HDRP( bp + d ), PACK( csize-d, 1 ) );
+        PUT( FTRP( bp + d ), PACK( csize-d, 1 ) );
+        coalesce( h, bp );
+        bp += d;
+    }
+    shrink_block( h, bp, asize );
+    return bp;
+}
 
-    if( ( bp = mem_sbrk( size ) ) == (void *)-1 )
-       return NULL;
+/*
+ * mapped_range - Whether the len bytes at p lie in one anonymous mapping
+ *                made by the allocator, where pages may be remapped
+ */
+static int mapped_range(mm_heap_t *h, char *p, size_t len)
+{
+    int i;
 
-    /* Initialize free block header/footer and the epilogue header */
-    PUT( HDRP( bp ), PACK( size, 0 ) );         /* free block header */
-    PUT( FTRP( bp ), PACK( size, 0 ) );         /* free block footer */
-    PUT( HDRP( NEXT_BLKP( bp ) ), PACK( 0, 1 ) ); /* new epilogue header */
+    if( p >= (char *)heap_lo( h ) && p + len <= (char *)heap_hi( h ) + 1 )
+        return ( h->flags & HEAP_MAPPED ) != 0;
+    for( i = 0; i < h->nsegs; i++ )
+        if( p >= h->segs[i].base && p + len <= h->segs[i].base + h->segs[i].len )
+            return ( h->segs[i].flags & SEG_MAPPED ) != 0;
+    return 0;
+}
 
-    /* Coalesce if the previous block was free */
-    return coalesce( bp );
+/*
+ * move_payload - Copy len bytes of payload from src to dst for realloc.
+ *                Large moves remap whole pages where the two line up and
+ *                otherwise use non-temporal stores, so that neither the
+ *                old nor the new copy is pulled through the cache.
+ */
+static void move_payload(mm_heap_t *h, char *dst, char *src, size_t len)
+{
+#ifndef MM_SIM
+    size_t head;
+
+    if( len < MOVE_THRESHOLD ) {
+        memcpy( dst, src, len );
+        return;
+    }
+    if( remap_payload( h, dst, src, len ) )
+        return;
+#ifdef __SSE2__
+    head = -(size_t)dst & 15;
+    memcpy( dst, src, head );
+    dst += head;
+    src += head;
+    len -= head;
+    for( ; len >= 64; len -= 64, dst += 64, src += 64 ) {
+        __m128i a = _mm_loadu_si128( (const __m128i *)src );
+        __m128i b = _mm_loadu_si128( (const __m128i *)( src + 16 ) );
+        __m128i c = _mm_loadu_si128( (const __m128i *)( src + 32 ) );
+        __m128i d = _mm_loadu_si128( (const __m128i *)( src + 48 ) );
+        _mm_stream_si128( (__m128i *)dst, a );
+        _mm_stream_si128( (__m128i *)( dst + 16 ), b );
+        _mm_stream_si128( (__m128i *)( dst + 32 ), c );
+        _mm_stream_si128( (__m128i *)( dst + 48 ), d );
+    }
+    _mm_sfence();
+#else
+    (void)head;
+#endif
+    memcpy( dst, src, len );
+#else
+    /* payloads are never touched in the simulation */
+    (void)h;
+    (void)dst;
+    (void)src;
+    (void)len;
+#endif
+}
+
+#ifndef MM_SIM
+/*
+ * remap_payload - Move the whole pages of src to dst with mremap, leaving
+ *                 the source range mapped but empty, and copy the partial
+ *                 pages at either end. Returns 0, having done nothing, if
+ *                 the two are not page congruent, not both in allocator
+ *                 mappings, or the kernel lacks MREMAP_DONTUNMAP.
+ */
+static int remap_payload(mm_heap_t *h, char *dst, char *src, size_t len)
+{
+    size_t pagesize = mem_pagesize();
+    char *from = (char *)PAGE_ROUND( (size_t)src, pagesize );
+    size_t head = from - src;
+    size_t body;
+
+    if( ( ( dst - src ) & ( pagesize-1 ) ) || head >= len )
+        return 0;
+    body = ( len - head ) & ~( pagesize-1 );
+    if( !body || !mapped_range( h, src, len ) || !mapped_range( h, dst, len ) )
+        return 0;
+    if( mremap( from, body, body, MREMAP_MAYMOVE | MREMAP_FIXED | MREMAP_DONTUNMAP,
+                dst + head ) == MAP_FAILED )
+        return 0;
+    memcpy( dst, src, head );
+    memcpy( dst + head + body, from + body, len - head - body );
+    return 1;
 }
+#endif
 
 /*
  * place - Place block of asize bytes at start of free block bp
  *         and split if remainder would be at least minimum block size
  */
-static void place(void *bp, size_t asize)
+static void place(mm_heap_t *h, void *bp, size_t asize)
 {
     size_t csize = GET_SIZE( HDRP( bp ) ); //get size of free block
 
 
-    if( ( csize - asize ) >= OVERHEAD ) { //if total size minus requested size is bigger than OVERHEAD, split it
+    if( ( csize - asize ) >= h->cfg.split ) { //if total size minus requested size is bigger than the split threshold, split it
         PUT( HDRP( bp ), PACK( asize, 1 ) );
         PUT( FTRP( bp ), PACK( asize, 1 ) );
-        delete_block(bp);//remove block from free list
+        delete_block(h, bp);//remove block from free list
         bp = NEXT_BLKP( bp );
         PUT( HDRP( bp ), PACK( csize-asize, 0 ) );
         PUT( FTRP( bp ), PACK( csize-asize, 0 ) );
-        coalesce(bp);
+        coalesce(h, bp);
     }
     else {//if space is not big enough anyways... dont split
         PUT( HDRP( bp ), PACK( csize, 1 ) );
         PUT( FTRP( bp ), PACK( csize, 1 ) );
-        delete_block(bp);//remove block from free list
+        delete_block(h, bp);//remove block from free list
     }
 }
 
 /*
  * find_fit - Find a fit for a block with asize bytes
  */
-static void *find_fit(size_t asize)
+static void *find_fit(mm_heap_t *h, size_t asize)
 {
-    /* first fit search */
     void *bp;
+    void *best = NULL;
+    void *spare = NULL;     /* first HEADROOM block that fits */
+    void *start;            /* where a next fit search began */
+    size_t largest = 0;     /* of the blocks passed, once the list is done */
+
+    /*
+     * HEADROOM blocks are passed over while anything else fits; when
+     * nothing else does they are handed out rather than growing the heap.
+     */
+    if( h->cfg.fit == MM_FIT_BEST ) {
+        /* best fit search: smallest block that fits, stop early on an exact one */
+        for( bp = h->free_listp; GET_ALLOC( HDRP( bp ) ) == 0; bp = NEXT_FREE( bp ) ) {
+            largest = MAX( largest, GET_SIZE( HDRP( bp ) ) );
+            if( asize > GET_SIZE( HDRP( bp ) ) )
+                continue;
+            if( GET_TAG( HDRP( bp ) ) ) {
+                if( !spare )
+                    spare = bp;
+            }
+            else if( !best || GET_SIZE( HDRP( bp ) ) < GET_SIZE( HDRP( best ) ) ) {
+                best = bp;
+                if( GET_SIZE( HDRP( bp ) ) == asize )
+                    return bp;
+            }
+        }
+        h->maxfree = largest;   /* the whole list was seen */
+        return best ? best : spare;
+    }
 
+    if( h->cfg.fit == MM_FIT_NEXT ) {
+        /* next fit search: resume at the rover and go round the list once */
+        start = h->rover && !GET_ALLOC( HDRP( h->rover ) ) ? h->rover : h->free_listp;
+        bp = start;
+        do {
+            if( GET_ALLOC( HDRP( bp ) ) ) {
+                /* end of the list: wrap round to the head */
+                if( ( bp = h->free_listp ) == start )
+                    break;
+                continue;
+            }
+            if( asize <= GET_SIZE( HDRP( bp ) ) ) {
+                if( !GET_TAG( HDRP( bp ) ) ) {
+                    h->rover = bp;
+                    return bp;
+                }
+                if( !spare )
+                    spare = bp;
+            }
+            largest = MAX( largest, GET_SIZE( HDRP( bp ) ) );
+            bp = NEXT_FREE( bp );
+        } while( bp != start );
+        h->maxfree = largest;   /* the whole list was seen */
+        return spare;
+    }
 
-    for( bp = free_listp; GET_ALLOC( HDRP( bp ) ) == 0; bp = NEXT_FREE( bp ) ) {//goes through the whole list
+    /* first fit search */
+    for( bp = h->free_listp; GET_ALLOC( HDRP( bp ) ) == 0; bp = NEXT_FREE( bp ) ) {//goes through the whole list
         if( asize <= GET_SIZE( HDRP( bp ) ) )  {//if the free block is big enough, return the pointer
-            return bp;
+            if( !GET_TAG( HDRP( bp ) ) )
+                return bp;
+            if( !spare )
+                spare = bp;
+        }
+        largest = MAX( largest, GET_SIZE( HDRP( bp ) ) );
+    }
+    h->maxfree = largest;   /* the whole list was seen */
+    return spare; /* no fit but headroom, or none at all */
+}
+
+/*
+ * adjust_size - Block size for a request of size bytes: payload plus
+ *               overhead, rounded to the alignment or, with size classes
+ *               configured, up to the next of cfg.classes steps per
+ *               power of two
+ */
+static size_t adjust_size(mm_heap_t *h, size_t size)
+{
+    size_t asize, step;
+
+    if( size <= DSIZE )
+        asize = DSIZE + OVERHEAD;
+    else
+        asize = DSIZE * ( ( size + (OVERHEAD) + ( DSIZE-1 ) ) / DSIZE );
+
+    if( h->cfg.classes ) {
+        for( step = DSIZE; step * 2 * h->cfg.classes <= asize; step *= 2 )
+            ;
+        asize = ( asize + step-1 ) / step * step;
+    }
+    return asize;
+}
+
+/*
+ * free_block - Coalesce free block bp and hand back what that frees up:
+ *              a whole mapped segment, or the tail of the main area
+ */
+static void free_block(mm_heap_t *h, void *bp)
+{
+    bp = coalesce( h, bp );
+    if( ( h->flags & MM_HEAP_SEGMENTED ) && release_segment( h, bp ) )
+        return;
+    if( h->backend->trim )
+        trim_heap( h, bp );
+}
+
+/*
+ * sweep_pending - Empty the pending bin: sort it by address, then free
+ *                 each run of blocks that touch as one block, so every
+ *                 run is coalesced and linked only once
+ */
+static void sweep_pending(mm_heap_t *h)
+{
+    char *bp, *next;
+    size_t size;
+
+    bp = sort_pending( h->pending, h->npending );
+    h->pending = NULL;
+    h->npending = 0;
+    while( bp ) {
+        size = GET_SIZE( HDRP( bp ) );
+        for( next = NEXT_FREE( bp ); next == bp + size; next = NEXT_FREE( next ) )
+            size += GET_SIZE( HDRP( next ) );
+        PUT( HDRP( bp ), PACK( size, 0 ) );
+        PUT( FTRP( bp ), PACK( size, 0 ) );
+        free_block( h, bp );
+        bp = next;
+    }
+}
+
+/*
+ * sort_pending - Merge sort the n blocks of list, linked through
+ *                NEXT_FREE, by address
+ */
+static void *sort_pending(void *list, size_t n)
+{
+    void *a, *b, *head, **tail;
+    size_t i;
+
+    if( n < 2 )
+        return list;
+    for( b = list, i = 1; i < n/2; i++ )
+        b = NEXT_FREE( b );
+    a = NEXT_FREE( b );
+    NEXT_FREE( b ) = NULL;
+    b = sort_pending( a, n - n/2 );
+    a = sort_pending( list, n/2 );
+
+    for( tail = &head; a && b; tail = &NEXT_FREE( *tail ) ) {
+        if( (char *)a < (char *)b ) {
+            *tail = a;
+            a = NEXT_FREE( a );
+        }
+        else {
+            *tail = b;
+            b = NEXT_FREE( b );
         }
     }
-    return NULL; /* no fit */
+    *tail = a ? a : b;
+    return head;
 }
 
 /*
  * coalesce - boundary tag coalescing. Return ptr to coalesced block
  */
-static void *coalesce(void *bp)
+static void *coalesce(mm_heap_t *h, void *bp)
 {
     size_t prev_alloc = GET_ALLOC( FTRP( PREV_BLKP( bp ) ) ) || PREV_BLKP(bp) == bp;
     size_t next_alloc = GET_ALLOC( HDRP( NEXT_BLKP( bp ) ) );
     size_t size = GET_SIZE( HDRP( bp ) );
 
     if( prev_alloc && next_alloc ) {            /* Case 1 */
-        freelist(bp);
+        freelist(h, bp);
         return bp;
     }
     else if( prev_alloc && !next_alloc ) {      // Case 2: block next to current block is free
         size += GET_SIZE( HDRP( NEXT_BLKP( bp ) ) );
-        delete_block(NEXT_BLKP(bp));//remove next block from free list
+        delete_block(h, NEXT_BLKP(bp));//remove next block from free list
         PUT( HDRP( bp ), PACK( size, 0 ) );
         PUT( FTRP( bp ), PACK( size, 0 ) );
     }
@@ -292,7 +2728,7 @@ static void *coalesce(void *bp)
     else if( !prev_alloc && next_alloc ) {      // Case 3: block before the current block is free
         size += GET_SIZE( HDRP( PREV_BLKP( bp ) ) );
         bp = PREV_BLKP(bp);
-        delete_block(bp);//remove previous block from free list
+        delete_block(h, bp);//remove previous block from free list
         PUT( HDRP(bp), PACK(size, 0));
         PUT( FTRP( bp ), PACK( size, 0 ) );
     }
@@ -301,46 +2737,197 @@ static void *coalesce(void *bp)
     else if(!prev_alloc && !next_alloc) {       // Case 4
         size += GET_SIZE( HDRP( PREV_BLKP( bp ) ) ) +
             GET_SIZE( HDRP( NEXT_BLKP( bp ) ) );
-        delete_block(PREV_BLKP(bp));//remove previous block from free list
-        delete_block(NEXT_BLKP(bp));//remove next block from free list
+        delete_block(h, PREV_BLKP(bp));//remove previous block from free list
+        delete_block(h, NEXT_BLKP(bp));//remove next block from free list
         bp = PREV_BLKP(bp);
         PUT( HDRP( bp ), PACK( size, 0 ) );
         PUT( FTRP( bp ), PACK( size, 0 ) );
     }
 
-    freelist(bp);//adds block to the freelist
+    freelist(h, bp);//adds block to the freelist
 
     return bp;
 }
 
-static void freelist(void *bp)
+static void freelist(mm_heap_t *h, void *bp)
 {
+  // The last block of the main area becomes the top chunk instead, headroom or not
+  if(GET(HDRP(NEXT_BLKP(bp))) == PACK(0, 1) && NEXT_BLKP(bp) == (char *)heap_hi(h) + 1)
+  {
+    PUT(HDRP(bp), PACK(GET_SIZE(HDRP(bp)), 0));
+    PUT(FTRP(bp), PACK(GET_SIZE(HDRP(bp)), 0));
+    h->top = bp;
+    return;
+  }
+  h->maxfree = MAX(h->maxfree, GET_SIZE(HDRP(bp)));//lets alloc_block skip searches that cannot succeed
+  if(h->cfg.order == MM_ORDER_ADDRESS)
+  {
+    // The treap finds the last free block below bp; bp is linked in right after it
+    void *pred = NULL, *n;
+
+    for(n = h->tree; n; )
+    {
+      if((char *)n < (char *)bp)
+      {
+        pred = n;
+        n = RIGHT_FREE(n);
+      }
+      else
+        n = LEFT_FREE(n);
+    }
+    h->tree = tree_insert(h->tree, bp);
+    if(pred)
+    {
+      NEXT_FREE(bp) = NEXT_FREE(pred);
+      PREV_FREE(NEXT_FREE(pred)) = bp;
+      PREV_FREE(bp) = pred;
+      NEXT_FREE(pred) = bp;
+      return;
+    }
+  }
   // This function is to insert into the front of the freelist and update the info required for a linked list
-  NEXT_FREE(bp) = free_listp; //sets next to start of the free list
-  PREV_FREE(free_listp) = bp; //sets current previous printer to the added block
+  NEXT_FREE(bp) = h->free_listp; //sets next to start of the free list
+  PREV_FREE(h->free_listp) = bp; //sets current previous printer to the added block
   PREV_FREE(bp) = NULL;//old free pointer set to null
-  free_listp = bp;//sets start of the new free list to the block just added so that block is the first one in the list
+  h->free_listp = bp;//sets start of the new free list to the block just added so that block is the first one in the list
 }
 
-static void delete_block(void *bp)//takes a block out of the free list
+static void delete_block(mm_heap_t *h, void *bp)//takes a block out of the free list
 {
+  if(bp == h->top)//the top chunk is not on the list
+  {
+    h->top = NULL;
+    return;
+  }
+  if(bp == h->rover)//the next search resumes after it
+    h->rover = NEXT_FREE(bp);
+  if(h->cfg.order == MM_ORDER_ADDRESS)
+    h->tree = tree_delete(h->tree, bp);
   if(PREV_FREE(bp) != NULL)//if previous block
   {
     NEXT_FREE(PREV_FREE(bp)) = NEXT_FREE(bp);//skips and sets pointer of the previous to the next block
   }
   else
   {
-    free_listp = NEXT_FREE(bp);//if there is no previous, sets the free list pointer to point at the next block
+    h->free_listp = NEXT_FREE(bp);//if there is no previous, sets the free list pointer to point at the next block
   }
   PREV_FREE(NEXT_FREE(bp)) = PREV_FREE(bp);//previous block pointer to the next, set to the previous
 
 }
 
-static int check_block(void *bp){
-    if(NEXT_FREE(bp) < mem_heap_lo() || NEXT_FREE(bp) > mem_heap_hi())//If next free pointer is out of the range of the memory
+/*
+ * reorder_free_list - Relink the free list of h in the order cfg.order
+ *                     asks for; any order is a valid LIFO list
+ */
+static void reorder_free_list(mm_heap_t *h)
+{
+    char *bp, *next, *end;
+
+    h->tree = NULL;
+    h->rover = NULL;
+    if( h->cfg.order != MM_ORDER_ADDRESS )
+        return;
+    for( end = h->free_listp; GET_ALLOC( HDRP( end ) ) == 0; end = NEXT_FREE( end ) )
+        ;
+    bp = h->free_listp;
+    h->free_listp = end;
+    for( ; bp != end; bp = next ) {
+        next = NEXT_FREE( bp );
+        freelist( h, bp );
+    }
+}
+
+/*
+ * tree_prio - Treap priority of free block bp, a hash of its address
+ */
+static unsigned tree_prio(void *bp)
+{
+    return (unsigned)( (size_t)bp >> 3 ) * 2654435761u;
+}
+
+/*
+ * tree_insert - Add free block bp to the treap at root; returns the new root
+ */
+static void *tree_insert(void *root, void *bp)
+{
+    void *child;
+
+    if( !root ) {
+        LEFT_FREE( bp ) = NULL;
+        RIGHT_FREE( bp ) = NULL;
+        return bp;
+    }
+    if( (char *)bp < (char *)root ) {
+        child = tree_insert( LEFT_FREE( root ), bp );
+        LEFT_FREE( root ) = child;
+        if( tree_prio( child ) > tree_prio( root ) ) {
+            /* rotate right */
+            LEFT_FREE( root ) = RIGHT_FREE( child );
+            RIGHT_FREE( child ) = root;
+            return child;
+        }
+    }
+    else {
+        child = tree_insert( RIGHT_FREE( root ), bp );
+        RIGHT_FREE( root ) = child;
+        if( tree_prio( child ) > tree_prio( root ) ) {
+            /* rotate left */
+            RIGHT_FREE( root ) = LEFT_FREE( child );
+            LEFT_FREE( child ) = root;
+            return child;
+        }
+    }
+    return root;
+}
+
+/*
+ * tree_delete - Take free block bp out of the treap at root; returns the
+ *               new root
+ */
+static void *tree_delete(void *root, void *bp)
+{
+    void *child;
+
+    if( root == bp )
+        return tree_join( LEFT_FREE( bp ), RIGHT_FREE( bp ) );
+    if( (char *)bp < (char *)root ) {
+        child = tree_delete( LEFT_FREE( root ), bp );
+        LEFT_FREE( root ) = child;
+    }
+    else {
+        child = tree_delete( RIGHT_FREE( root ), bp );
+        RIGHT_FREE( root ) = child;
+    }
+    return root;
+}
+
+/*
+ * tree_join - Merge treaps a and b, every block of a lying below every
+ *             block of b; returns the new root
+ */
+static void *tree_join(void *a, void *b)
+{
+    void *child;
+
+    if( !a )
+        return b;
+    if( !b )
+        return a;
+    if( tree_prio( a ) > tree_prio( b ) ) {
+        child = tree_join( RIGHT_FREE( a ), b );
+        RIGHT_FREE( a ) = child;
+        return a;
+    }
+    child = tree_join( a, LEFT_FREE( b ) );
+    LEFT_FREE( b ) = child;
+    return b;
+}
+
+static int check_block(mm_heap_t *h, void *bp){
+    if(!in_heap(h, NEXT_FREE(bp)))//If next free pointer is out of the range of the memory
         return 0;
 
-    if(PREV_FREE(bp) < mem_heap_lo() || PREV_FREE(bp) > mem_heap_hi())//If previous free pointer is out of the range of memory
+    if(!in_heap(h, PREV_FREE(bp)))//If previous free pointer is out of the range of memory
         return 0;
 
     if((size_t)bp % 8)//If no alignment is done
@@ -351,3 +2938,134 @@ static int check_block(void *bp){
 
     return 1;//else, block is good
 }
+
+#ifdef MM_SIM
+/*
+ * sim_alloc, sim_free - Track the requested payload of a block. It is
+ *                       kept in the side table under bp+WSIZE, a word
+ *                       the allocator itself never uses.
+ */
+static void sim_alloc(mm_heap_t *h, void *bp, size_t size)
+{
+    *oob_word( (char *)bp + WSIZE ) = size;
+    h->payload += size;
+    h->peak_payload = MAX( h->peak_payload, h->payload );
+}
+
+static void sim_free(mm_heap_t *h, void *bp)
+{
+    h->payload -= oob_get( (char *)bp + WSIZE );
+}
+#endif /* MM_SIM */
+
+#if defined(MM_SIM) || defined(MM_OOB)
+/*
+ * The shadow array: a root and middle level of OOB_BITS each over leaves
+ * of 2^OOB_LEAFBITS slots, for 48-bit addresses. Leaves are reserved
+ * without backing, so only shadow pages next to live metadata take
+ * memory. The word at p goes in slot OOB_SLOT(p): out of band that is
+ * (p + WSIZE) / DSIZE, so a header and the footer of the block below it
+ * sit in adjacent doublewords; simulated, every word has a slot.
+ */
+static oob_t **oob_map[1 << OOB_BITS];
+
+/*
+ * oob_slot - Slot number g, or NULL if its leaf is not there yet and
+ *            make is not set
+ */
+static oob_t *oob_slot(size_t g, int make)
+{
+    void **slot = (void **)&oob_map[( g >> ( OOB_LEAFBITS + OOB_BITS ) ) & ( ( 1 << OOB_BITS ) - 1 )];
+    size_t len = ( (size_t)1 << OOB_BITS ) * sizeof( void * );
+    void *node, *old;
+    int level;
+
+    for( level = 0; ; level++ ) {
+        if( ( node = __atomic_load_n( slot, __ATOMIC_ACQUIRE ) ) == NULL ) {
+            if( !make )
+                return NULL;
+            node = mmap( NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0 );
+            if( node == MAP_FAILED ) {
+                printf( "ERROR: out of memory for the metadata shadow\n" );
+                exit( 1 );
+            }
+            old = NULL;
+            if( !__atomic_compare_exchange_n( slot, &old, node, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE ) ) {
+                munmap( node, len );    /* another thread was first */
+                node = old;
+            }
+        }
+        if( level == 1 )
+            return (oob_t *)node + ( g & ( ( (size_t)1 << OOB_LEAFBITS ) - 1 ) );
+        slot = (void **)node + ( ( g >> OOB_LEAFBITS ) & ( ( 1 << OOB_BITS ) - 1 ) );
+        len = ( (size_t)1 << OOB_LEAFBITS ) * sizeof( oob_t );
+    }
+}
+
+/*
+ * oob_find - Slot of the word at p if its leaf is there, else NULL; the
+ *            lookup every GET and PUT makes, so kept to two loads
+ */
+static inline oob_t *oob_find(void *p)
+{
+    size_t g = OOB_SLOT( p );
+    oob_t **mid, *leaf;
+
+    mid = __atomic_load_n( &oob_map[( g >> ( OOB_LEAFBITS + OOB_BITS ) ) & ( ( 1 << OOB_BITS ) - 1 )], __ATOMIC_ACQUIRE );
+    if( !mid || ( leaf = __atomic_load_n( &mid[( g >> OOB_LEAFBITS ) & ( ( 1 << OOB_BITS ) - 1 )], __ATOMIC_ACQUIRE ) ) == NULL )
+        return NULL;
+    return leaf + ( g & ( ( (size_t)1 << OOB_LEAFBITS ) - 1 ) );
+}
+
+/*
+ * oob_get - Word at p; never written words read as zero
+ */
+static size_t oob_get(void *p)
+{
+    oob_t *w = oob_find( p );
+
+    return w ? *w : 0;
+}
+
+/*
+ * oob_word - Slot for the word at p, made if need be
+ */
+static oob_t *oob_word(void *p)
+{
+    oob_t *w = oob_find( p );
+
+    return w ? w : oob_slot( OOB_SLOT( p ), 1 );
+}
+
+/*
+ * oob_clear - Zero the shadow of the words from lo up to hi, handing
+ *             whole shadow pages back to the system. A slot goes with
+ *             the header position it holds, so the header just below lo
+ *             survives a trim.
+ */
+static void oob_clear(char *lo, char *hi)
+{
+    size_t pagesize = mem_pagesize();
+    size_t leaf = (size_t)1 << OOB_LEAFBITS;
+    size_t g = OOB_SLOT( lo + OOB_GRAIN-1 );
+    size_t gend = OOB_SLOT( hi + OOB_GRAIN-1 );
+    size_t stop;
+    char *w, *end, *page, *last;
+
+    for( ; g < gend; g = stop ) {
+        /* one leaf at a time */
+        stop = MIN( ( g | ( leaf-1 ) ) + 1, gend );
+        if( ( w = (char *)oob_slot( g, 0 ) ) == NULL )
+            continue;
+        end = w + ( stop - g ) * sizeof( oob_t );
+        page = (char *)PAGE_ROUND( (size_t)w, pagesize );
+        last = (char *)( (size_t)end & ~( pagesize-1 ) );
+        if( last > page ) {
+            memset( w, 0, page - w );
+            madvise( page, last - page, MADV_DONTNEED );
+            w = last;
+        }
+        memset( w, 0, end - w );
+    }
+}
+#endif /* MM_SIM || MM_OOB */
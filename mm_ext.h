@@ -0,0 +1,212 @@
+/*
+ * mm_ext.h - Extensions to the mm.h interface.
+ *
+ * A heap handle holds all state of one allocator instance. mm_init,
+ * mm_malloc, mm_free and mm_realloc operate on a default heap that
+ * grows through memlib; mm_heap_create makes further heaps that are
+ * completely independent of it and of each other.
+ *
+ * Buffer heaps live entirely inside memory supplied by the caller and
+ * never call mem_sbrk or mmap; once their regions are used up further
+ * allocations return NULL. More regions can be chained on later.
+ *
+ * A segmented heap is made of separately mapped segments, each with its
+ * own prologue and epilogue. It does not need the address space above
+ * the heap to be free, and it unmaps a segment as soon as every block
+ * in it has been freed.
+ *
+ * A reserved heap takes its whole address range up front without
+ * backing it, commits pages as the heap grows and decommits them again
+ * when a large block at the top of the heap is freed. Addresses stay
+ * stable and growth never copies or moves anything.
+ *
+ * MM_HEAP_HUGEPAGE aligns the main area and every segment to 2 MiB,
+ * commits and maps in whole huge pages, asks for transparent huge pages
+ * on them and never decommits part of a huge page, to cut TLB misses on
+ * large heaps.
+ *
+ * A checkpoint stores a heap's memory together with its metadata. Restoring
+ * it maps the memory back at the same addresses, so pointers stored in
+ * the heap stay valid and allocation carries on where it left off. A
+ * memlib heap can only be restored if memlib sits at the same address.
+ * A restore that fails leaves the default heap as it was, for a memlib
+ * checkpoint too: its image is read aside and memlib grown to hold it
+ * before the heap is given up. A restored heap can be checkpointed again
+ * to the file it came from.
+ *
+ * Deterministic mode maps a heap at a fixed base (mm_init_at,
+ * mm_heap_create_at, or MM_HEAP_BASE and optionally MM_HEAP_SIZE in the
+ * environment of a program that calls mm_init). Placement depends only on
+ * the sequence of operations, so replaying a trace gives the same
+ * addresses every run. mm_digest hashes the resulting layout for
+ * comparing runs.
+ *
+ * Building mm.c with -DMM_SIM gives a simulation build. It runs the same
+ * placement, coalescing and growth logic, but keeps all block metadata
+ * in a side table and never reads, writes or copies payloads. Sizes and
+ * fragmentation match the real allocator exactly. The pointers it
+ * returns must not be dereferenced. The side table is indexed directly
+ * by address, as the shadow of the out-of-band build is, and is shared by
+ * all threads. Each metadata access costs two dependent loads, so on
+ * traces of small blocks whose heap stays in cache the simulation runs
+ * at about half the speed of the real build; it pays off on traces
+ * dominated by page faults and payload copies.
+ *
+ * Every heap has its own placement and growth policy: fit strategy, the
+ * least amount the heap grows by, the split threshold and optional size
+ * classes. mm_heap_configure changes it, so several policies can be
+ * compared on one trace in one process (see mmeval.c). A nonzero defer
+ * lets that many freed blocks wait unmerged in a pending bin; a full bin,
+ * or an allocation nothing else fits, sweeps it in address order.
+ * MM_ORDER_ADDRESS keeps the free list sorted by address, which turns
+ * first fit into address-ordered first fit, at the cost of a tree
+ * update on every insertion and removal.
+ * MM_FIT_NEXT starts each search at a roving pointer where the previous
+ * one stopped instead of at the head of the list.
+ *
+ * mm_malloc_hint places blocks expected to be short- or long-lived in
+ * arenas of their own, so blocks of one lifetime do not leave holes
+ * between blocks of the other. Blocks without a hint stay in the heap
+ * itself. mm_free and mm_realloc take blocks from any arena, and the
+ * heap figures include them. Arenas start with the policy of their heap
+ * and follow every later mm_heap_configure of it. A heap with arenas
+ * cannot be checkpointed.
+ *
+ * mm_predict makes the hints automatic. Allocations are keyed by the
+ * caller's return address and a sample of blocks is timed from malloc to
+ * free; sites whose blocks mostly outlive the given number of operations
+ * get the long-lived arena from then on. Wrappers that allocate for
+ * someone else pass the real site to mm_heap_malloc_site.
+ *
+ * Every page the allocator maps is recorded in a process-wide page map,
+ * so mm_heap_of finds the heap of a block in constant time. mm_free and
+ * mm_realloc use it to give blocks of mapped heaps back to, or resize
+ * them in, the heap they came from; blocks of buffer heaps and of the
+ * memlib heap are not in the map and go to the default heap as before.
+ *
+ * Building mm.c with -DMM_OOB moves headers and footers out of the heap
+ * into a shadow array, so freeing and coalescing only write to the free
+ * block itself and no longer dirty the cache lines of neighbouring
+ * payloads. Placement and addresses are the same as in the normal build.
+ * The shadow takes 4 bytes per 8 bytes of heap wherever blocks are small,
+ * so a heap of small blocks needs up to half its size again in memory;
+ * it is handed back when the heap or one of its segments is unmapped.
+ * Such heaps cannot be checkpointed.
+ */
+#ifndef MM_EXT_H
+#define MM_EXT_H
+
+#include <stddef.h>
+
+typedef struct mm_heap mm_heap_t;
+
+/* fit policies */
+#define MM_FIT_FIRST 0          /* first block on the free list that fits */
+#define MM_FIT_BEST  1          /* smallest block on the free list that fits */
+#define MM_FIT_NEXT  2          /* first fit, resuming where the last search ended */
+
+/* free list orders */
+#define MM_ORDER_LIFO    0      /* freed blocks go to the front */
+#define MM_ORDER_ADDRESS 1      /* sorted by address */
+
+/*
+ * Placement and growth policy of a heap. Each heap has its own, so heaps
+ * with different policies can run side by side in one process.
+ */
+struct mm_config {
+    int fit;                /* MM_FIT_* */
+    size_t chunksize;       /* least the heap grows by at a time (bytes) */
+    size_t split;           /* least remainder place() splits off (bytes) */
+    int classes;            /* size classes per power of two (0: none) */
+    size_t defer;           /* freed blocks held back before one coalescing sweep (0: none) */
+    int order;              /* MM_ORDER_* */
+};
+
+/*
+ * Heap figures. Utilization is peak_payload / heapsize and fragmentation
+ * 1 - largest_free / free_bytes. The payload figures need the requested
+ * sizes and are only kept by the simulation build (-DMM_SIM).
+ */
+struct mm_stats {
+    size_t heapsize;        /* bytes the heap spans now */
+    size_t peak_heapsize;   /* most bytes it has ever spanned */
+    size_t free_bytes;      /* bytes in free blocks */
+    size_t free_blocks;     /* number of free blocks */
+    size_t largest_free;    /* size of the largest free block */
+    size_t payload;         /* requested bytes in allocated blocks */
+    size_t peak_payload;    /* most requested bytes ever live at once */
+};
+
+/* mm_heap_create_ex flags */
+#define MM_HEAP_SEGMENTED 0x1   /* grow by mapping discontiguous segments */
+#define MM_HEAP_RESERVE   0x2   /* reserve address space, commit on demand */
+#define MM_HEAP_HUGEPAGE  0x4   /* 2 MiB aligned, grown in huge pages */
+
+/* heap instances */
+extern mm_heap_t *mm_heap_create(size_t maxsize);
+extern mm_heap_t *mm_heap_create_ex(size_t maxsize, unsigned flags);
+extern mm_heap_t *mm_heap_create_at(void *base, size_t maxsize, unsigned flags);
+extern void mm_heap_destroy(mm_heap_t *h);
+extern void *mm_heap_malloc(mm_heap_t *h, size_t size);
+extern void mm_heap_free(mm_heap_t *h, void *ptr);
+extern void *mm_heap_realloc(mm_heap_t *h, void *ptr, size_t size);
+extern int mm_heap_checkheap(mm_heap_t *h);
+extern mm_heap_t *mm_heap_of(void *ptr);
+
+/* default heap over a reserve/commit mapping instead of memlib */
+extern int mm_init_reserve(size_t maxsize);
+extern int mm_init_ex(size_t maxsize, unsigned flags);
+extern int mm_init_at(void *base, size_t maxsize, unsigned flags);
+
+/* placement and growth policy */
+extern int mm_configure(const struct mm_config *cfg);
+extern int mm_heap_configure(mm_heap_t *h, const struct mm_config *cfg);
+extern void mm_heap_get_config(mm_heap_t *h, struct mm_config *cfg);
+
+/* mm_malloc_hint lifetimes */
+#define MM_SHORT_LIVED 0x1      /* expected to be freed soon */
+#define MM_LONG_LIVED  0x2      /* expected to outlive most other blocks */
+
+/* allocation with a lifetime hint */
+extern void *mm_malloc_hint(size_t size, unsigned hint);
+extern void *mm_heap_malloc_hint(mm_heap_t *h, size_t size, unsigned hint);
+
+/* lifetime prediction by allocation site */
+extern int mm_predict(size_t lifetime);
+extern int mm_heap_predict(mm_heap_t *h, size_t lifetime);
+extern void *mm_heap_malloc_site(mm_heap_t *h, size_t size, void *site);
+
+/* usable sizes, rounding included */
+extern size_t mm_usable_size(void *ptr);
+extern size_t mm_malloc_size_hint(size_t size);
+extern size_t mm_heap_malloc_size_hint(mm_heap_t *h, size_t size);
+
+/* heap figures */
+extern void mm_stats(struct mm_stats *st);
+extern void mm_heap_stats(mm_heap_t *h, struct mm_stats *st);
+
+/* layout hash for reproducibility checks */
+extern unsigned long long mm_digest(void);
+extern unsigned long long mm_heap_digest(mm_heap_t *h);
+
+/* mm_reserve flags */
+#define MM_RESERVE_PREFAULT 0x1 /* take the page faults up front */
+#define MM_RESERVE_LOCK     0x2 /* mlock the reserved pages */
+
+/* grow a heap ahead of time */
+extern int mm_reserve(size_t bytes, unsigned flags);
+extern int mm_heap_reserve(mm_heap_t *h, size_t bytes, unsigned flags);
+
+/* checkpoint and restore at the same addresses */
+extern int mm_checkpoint(const char *path);
+extern int mm_restore(const char *path);
+extern int mm_heap_checkpoint(mm_heap_t *h, const char *path);
+extern mm_heap_t *mm_heap_restore(const char *path);
+
+/* heaps over caller-supplied memory */
+extern int mm_init_in_buffer(void *buf, size_t len);
+extern int mm_add_region(void *buf, size_t len);
+extern mm_heap_t *mm_heap_create_in_buffer(void *buf, size_t len);
+extern int mm_heap_add_region(mm_heap_t *h, void *buf, size_t len);
+
+#endif /* MM_EXT_H */
@@ -0,0 +1,1899 @@
+/*
+ * mmeval.c - Replay one trace against several allocator policies at once.
+ *
+ * Each policy gets its own heap (mm_heap_create_ex) configured through
+ * mm_heap_configure, and worker threads take policies off a shared
+ * counter until all have run. Heaps share nothing, so the results are the
+ * same whatever the number of threads. The trace is read and parsed once
+ * and shared read-only between the workers; payloads are never touched,
+ * so mm.c built with -DMM_SIM evaluates without committing heap memory.
+ *
+ *     gcc -O2 -o mmeval mmeval.c mm.c memlib.c -lpthread
+ *     gcc -O2 -DMM_SIM -o mmeval-sim mmeval.c mm.c memlib.c -lpthread
+ *     gcc -O2 -DMM_OOB -o mmeval-oob mmeval.c mm.c memlib.c -lpthread
+ *
+ * All build as 32 or 64-bit programs; tags are 4-byte words either
+ * way, so a heap (-m) can be at most a little under 4 GiB.
+ *
+ *     mmeval [-p] [-t threads] [-m maxheap] [-L ops] [-P ops] [-R base]
+ *            [-c policy]... tracefile
+ *
+ * A policy is a comma separated list of fit=first|best|next, chunk=<bytes>,
+ * split=<bytes>, classes=<n>, defer=<blocks> and order=lifo|address;
+ * fields left out keep their defaults.
+ * Without -c a small grid over fit, chunk and classes is run.
+ *
+ * -L ops allocates through mm_heap_malloc_hint with perfect lifetime
+ * hints taken from the trace itself: blocks freed within ops operations
+ * are MM_SHORT_LIVED, the rest MM_LONG_LIVED. Comparing with a run
+ * without -L shows what separating lifetimes can gain on a trace.
+ *
+ * -P ops instead turns on mm_heap_predict with a threshold of ops and
+ * passes each allocation's call site from the trace to
+ * mm_heap_malloc_site, so the allocator has to learn the lifetimes. Sites
+ * are the optional fourth field of an "a" line, as gentrace -S writes
+ * them; allocations without one count as a single site.
+ *
+ * -R base checks that replays are reproducible. Every policy is replayed
+ * twice in a heap made with mm_heap_create_at, policy i at base plus i
+ * times maxheap (rounded up to 2 MiB), and the "repro" column says
+ * whether both replays got the same address from every allocation and
+ * the same mm_heap_digest at the end. Heaps at a fixed base get no
+ * arenas, so -L changes nothing there and -P cannot be combined with -R.
+ *
+ * Traces use the malloc lab format: four header numbers (suggested heap
+ * size, number of ids, number of operations, weight) followed by one
+ * operation per line, "a id size [site]", "r id size" or "f id".
+ *
+ * For every policy it prints throughput, peak utilization (most payload
+ * live at once over the largest heap) and the fragmentation of the free
+ * space left at the end (1 - largest free block / free bytes).
+ *
+ * With -p it also reads hardware counters through perf_event_open: cycles,
+ * instructions, L1 data and last level cache misses, dTLB misses and
+ * branch misses, in user mode only. Each operation type has its own
+ * counter group that is switched on just around operations of that type,
+ * and the cost of switching, measured on an empty section before the
+ * replay, is taken off again. Results are per operation. Counters the
+ * kernel or the CPU does not offer show as "-", and without any the tool
+ * just runs without them. Switching costs two system calls per operation,
+ * so ops/sec is only meaningful without -p.
+ *
+ *     mmeval -w workload[,n]
+ *
+ * runs one of the built-in workloads below instead of a trace, each
+ * measuring one feature of the allocator against its alternative; n
+ * scales the workload (see mmeval -w help).
+ *
+ *   heaps      subsystems each with a heap of their own against all of
+ *              them in one shared heap: throughput and teardown time
+ *   buffer     steady state in a heap over a caller buffer against mapped
+ *              heaps: throughput, page faults and system time
+ *   release    growing a large heap and freeing it again, in segmented,
+ *              reserve and region heaps: time and size left over
+ *   grow       growing the memlib heap against the region and reserve
+ *              backends: time per allocation, freeing and trimming
+ *   tlb        random reads over the blocks of a large heap, with and
+ *              without huge pages: time and dTLB misses per read
+ *   first      latency of the first requests served by a new heap, with
+ *              and without mm_heap_reserve ahead of them
+ *   restore    rebuilding a linked structure against restoring it from a
+ *              checkpoint and walking it
+ *   append     string builders growing by realloc, against moving on every
+ *              growth and against doubling in the caller: copies and time
+ *   move       realloc moves of large blocks by remapping and by streaming
+ *              stores, against memcpy: bandwidth, and the slowdown of a
+ *              thread walking a cache-resident working set meanwhile
+ *   vector     vectors growing by half their capacity, with and without
+ *              mm_usable_size and mm_heap_malloc_size_hint: reallocs
+ *   ramp       allocation throughput of a fresh heap as it grows from
+ *              nothing, against the C library's malloc
+ *   scratch    nested scratch buffers freed in reverse order, against
+ *              other free orders and the C library: ns per pair
+ *   pagemap    mm_heap_of on segmented heaps of 1 GiB up: ns per lookup
+ *              and the memory the page map takes
+ *   neighbour  a thread writing payloads while another frees and
+ *              allocates the blocks between them: ns and L1d misses per
+ *              write; run it in a -DMM_OOB build as well to compare
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "mm.h"
+#include "mm_ext.h"
+#include "memlib.h"
+
+#define MAX(x, y) ( (x) > (y) ? (x) : (y) )
+#define MIN(x, y) ( (x) < (y) ? (x) : (y) )
+
+#define MAXPOLICIES 64
+#define DEFMAXHEAP  ( (size_t)1 << 30 )   /* address space reserved per heap */
+
+/* one trace operation */
+struct op {
+    char type;          /* 'a', 'r' or 'f' */
+    long id;            /* block the operation applies to */
+    size_t size;        /* requested bytes for 'a' and 'r' */
+    long life;          /* 'a': operations until its free, -1: never */
+    long site;          /* 'a': call site, -1: not recorded */
+};
+
+struct trace {
+    long num_ids;
+    long num_ops;
+    struct op *ops;
+};
+
+/* operation types counters are kept for */
+enum { OP_MALLOC, OP_FREE, OP_REALLOC, NOPTYPES };
+static const char *op_names[NOPTYPES] = { "malloc", "free", "realloc" };
+
+/* hardware counters read with -p */
+#define NCOUNTERS 6
+#define L1D_COUNTER  2      /* index of L1d-miss in counters */
+#define DTLB_COUNTER 4      /* index of dTLB-miss in counters */
+#define HW_CACHE_MISS(cache) \
+    ( (cache) | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16 )
+
+static const struct counter {
+    const char *name;
+    unsigned type;
+    unsigned long long config;
+} counters[NCOUNTERS] = {
+    { "cycles",    PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { "instrs",    PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { "L1d-miss",  PERF_TYPE_HW_CACHE, HW_CACHE_MISS( PERF_COUNT_HW_CACHE_L1D ) },
+    { "LLC-miss",  PERF_TYPE_HW_CACHE, HW_CACHE_MISS( PERF_COUNT_HW_CACHE_LL ) },
+    { "dTLB-miss", PERF_TYPE_HW_CACHE, HW_CACHE_MISS( PERF_COUNT_HW_CACHE_DTLB ) },
+    { "br-miss",   PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+};
+
+/* one counter group; fd is -1 for counters that could not be opened */
+struct pgroup {
+    int fd[NCOUNTERS];
+    int leader;             /* fd that switches the group, -1: none */
+};
+
+/* counts for one operation type */
+struct opcount {
+    unsigned long long ops;
+    double val[NCOUNTERS];
+    int valid[NCOUNTERS];   /* counter was open and got scheduled */
+};
+
+/* one policy and what it scored */
+struct policy {
+    char name[64];
+    struct mm_config cfg;
+    int failed;             /* trace could not be replayed */
+    double secs;
+    size_t peak_payload;
+    struct mm_stats st;     /* at the end of the trace */
+    struct opcount count[NOPTYPES];
+    char *base;             /* -R: where its heap is mapped */
+    unsigned long long digest;  /* -R: hash of every address and the final layout */
+    int repro;              /* -R: a second replay gave the same digest */
+};
+
+static struct trace trace;
+static struct policy policies[MAXPOLICIES];
+static int npolicies;
+static int next_policy;     /* next policy a worker takes */
+static size_t maxheap = DEFMAXHEAP;
+static int perf;            /* -p: read hardware counters */
+static long lifetime_split; /* -L: hint lifetimes, short below this */
+static long predict;        /* -P: lifetime threshold for prediction */
+static char *fixed_base;    /* -R: base of the heap of the first policy */
+static int perf_missing;    /* some counter could not be opened */
+
+/* a built-in workload, run with -w */
+struct workload {
+    const char *name;
+    void (*run)(long n);
+    long n;                 /* default scale */
+    const char *help;
+};
+
+static void bench_heaps(long n);
+static void bench_buffer(long n);
+static void bench_release(long n);
+static void bench_grow(long n);
+static void bench_tlb(long n);
+static void bench_first(long n);
+static void bench_restore(long n);
+static void bench_append(long n);
+static void bench_move(long n);
+static void bench_vector(long n);
+static void bench_ramp(long n);
+static void bench_scratch(long n);
+static void bench_pagemap(long n);
+static void bench_neighbour(long n);
+
+static const struct workload workloads[] = {
+    { "heaps", bench_heaps, 100000, "per-subsystem heaps against a shared heap; n rounds of ops" },
+    { "buffer", bench_buffer, 1000000, "steady state over a caller buffer against mapped heaps; n ops" },
+    { "release", bench_release, 1024, "grow a heap to n MiB and free it again" },
+    { "grow", bench_grow, 16, "grow each backend by n MiB of 64-byte blocks" },
+    { "tlb", bench_tlb, 512, "random reads over n MiB of blocks, with and without huge pages" },
+    { "first", bench_first, 2000, "latency of the first n requests, with and without a reservation" },
+    { "restore", bench_restore, 1000000, "rebuild a structure of n nodes against restoring a checkpoint of it" },
+    { "append", bench_append, 500000, "n appends to string builders grown by realloc" },
+    { "move", bench_move, 8, "realloc moves of n MiB blocks next to a thread walking a hot set" },
+    { "vector", bench_vector, 2000000, "n pushes to vectors, with and without the size queries" },
+    { "ramp", bench_ramp, 1000000, "n allocations into a fresh heap" },
+    { "scratch", bench_scratch, 1000000, "n rounds of nested scratch buffers" },
+    { "pagemap", bench_pagemap, 64, "page map lookups and size for heaps of 1 GiB up to n GiB" },
+    { "neighbour", bench_neighbour, 20000, "n passes writing payloads next to blocks being freed" },
+};
+#define NWORKLOADS ( (int)( sizeof( workloads ) / sizeof( workloads[0] ) ) )
+
+/*
+ * load_trace - Map tracefile and parse it into trace; exits on error.
+ *              The file is mapped over one more zeroed byte than it
+ *              has, so the text always ends in a NUL for strtol.
+ */
+static void load_trace(const char *path)
+{
+    struct stat sb;
+    char *text, *p, *q;
+    long hdr[4];
+    long *last;         /* op that allocated each live id, -1: none */
+    long i, n;
+    int fd;
+
+    if( ( fd = open( path, O_RDONLY ) ) == -1 || fstat( fd, &sb ) == -1 ) {
+        perror( path );
+        exit( 1 );
+    }
+    text = mmap( NULL, sb.st_size + 1, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+    if( text == MAP_FAILED || ( sb.st_size &&
+        mmap( text, sb.st_size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0 ) == MAP_FAILED ) ) {
+        perror( path );
+        exit( 1 );
+    }
+    close( fd );
+
+    p = text;
+    for( i = 0; i < 4; i++ ) {
+        hdr[i] = strtol( p, &q, 10 );
+        if( q == p ) {
+            fprintf( stderr, "%s: bad trace header\n", path );
+            exit( 1 );
+        }
+        p = q;
+    }
+    trace.num_ids = hdr[1];
+    if( trace.num_ids <= 0 || hdr[2] < 0 || ( trace.ops = malloc( ( hdr[2] + 1 ) * sizeof( struct op ) ) ) == NULL ) {
+        fprintf( stderr, "%s: bad trace header\n", path );
+        exit( 1 );
+    }
+
+    for( n = 0; n < hdr[2]; n++ ) {
+        struct op *o = &trace.ops[n];
+
+        while( *p == ' ' || *p == '\t' || *p == '\n' || *p == '\r' )
+            p++;
+        if( !*p )
+            break;
+        o->type = *p++;
+        o->id = strtol( p, &q, 10 );
+        p = q;
+        o->size = 0;
+        if( o->type == 'a' || o->type == 'r' ) {
+            o->size = strtoul( p, &q, 10 );
+            p = q;
+        }
+        o->site = -1;
+        if( o->type == 'a' ) {
+            /* the site, if any, is on the same line */
+            while( *p == ' ' || *p == '\t' )
+                p++;
+            if( *p >= '0' && *p <= '9' )
+                o->site = strtol( p, &p, 10 );
+        } else if( o->type != 'r' && o->type != 'f' ) {
+            fprintf( stderr, "%s: bad operation '%c' at op %ld\n", path, o->type, n );
+            exit( 1 );
+        }
+        if( o->id < 0 || o->id >= trace.num_ids ) {
+            fprintf( stderr, "%s: id %ld out of range at op %ld\n", path, o->id, n );
+            exit( 1 );
+        }
+    }
+    trace.num_ops = n;
+    munmap( text, sb.st_size + 1 );
+
+    /* lifetimes, for -L; a block must be allocated before it is resized or freed */
+    if( ( last = malloc( trace.num_ids * sizeof( *last ) ) ) == NULL ) {
+        perror( "malloc" );
+        exit( 1 );
+    }
+    for( i = 0; i < trace.num_ids; i++ )
+        last[i] = -1;
+    for( n = 0; n < trace.num_ops; n++ ) {
+        struct op *o = &trace.ops[n];
+
+        if( o->type == 'a' ) {
+            o->life = -1;
+            last[o->id] = n;
+            continue;
+        }
+        if( last[o->id] < 0 ) {
+            fprintf( stderr, "%s: id %ld not allocated at op %ld\n", path, o->id, n );
+            exit( 1 );
+        }
+        if( o->type == 'f' ) {
+            trace.ops[last[o->id]].life = n - last[o->id];
+            last[o->id] = -1;
+        }
+    }
+    free( last );
+}
+
+/*
+ * parse_policy - Fill in policy from a spec like "fit=best,chunk=4096";
+ *                returns -1 on an unknown field
+ */
+static int parse_policy(struct policy *pol, const char *spec)
+{
+    char buf[256], *field, *save;
+
+    memset( pol, 0, sizeof( *pol ) );
+    pol->cfg.fit = MM_FIT_FIRST;
+    snprintf( pol->name, sizeof( pol->name ), "%s", spec );
+    snprintf( buf, sizeof( buf ), "%s", spec );
+
+    for( field = strtok_r( buf, ",", &save ); field; field = strtok_r( NULL, ",", &save ) ) {
+        char *val = strchr( field, '=' );
+
+        if( !val )
+            return -1;
+        *val++ = '\0';
+        if( !strcmp( field, "fit" ) && !strcmp( val, "first" ) )
+            pol->cfg.fit = MM_FIT_FIRST;
+        else if( !strcmp( field, "fit" ) && !strcmp( val, "best" ) )
+            pol->cfg.fit = MM_FIT_BEST;
+        else if( !strcmp( field, "fit" ) && !strcmp( val, "next" ) )
+            pol->cfg.fit = MM_FIT_NEXT;
+        else if( !strcmp( field, "chunk" ) )
+            pol->cfg.chunksize = strtoul( val, NULL, 0 );
+        else if( !strcmp( field, "split" ) )
+            pol->cfg.split = strtoul( val, NULL, 0 );
+        else if( !strcmp( field, "classes" ) )
+            pol->cfg.classes = atoi( val );
+        else if( !strcmp( field, "defer" ) )
+            pol->cfg.defer = strtoul( val, NULL, 0 );
+        else if( !strcmp( field, "order" ) && !strcmp( val, "lifo" ) )
+            pol->cfg.order = MM_ORDER_LIFO;
+        else if( !strcmp( field, "order" ) && !strcmp( val, "address" ) )
+            pol->cfg.order = MM_ORDER_ADDRESS;
+        else
+            return -1;
+    }
+    return 0;
+}
+
+/*
+ * group_open - Open the counters of g for the calling thread, disabled.
+ *              Counters that fail are left out of the group.
+ */
+static void group_open(struct pgroup *g)
+{
+    struct perf_event_attr attr;
+    int i;
+
+    g->leader = -1;
+    for( i = 0; i < NCOUNTERS; i++ ) {
+        memset( &attr, 0, sizeof( attr ) );
+        attr.size = sizeof( attr );
+        attr.type = counters[i].type;
+        attr.config = counters[i].config;
+        attr.disabled = g->leader < 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                           PERF_FORMAT_TOTAL_TIME_RUNNING;
+        g->fd[i] = syscall( SYS_perf_event_open, &attr, 0, -1,
+                            g->leader < 0 ? -1 : g->fd[g->leader], 0 );
+        if( g->fd[i] < 0 )
+            perf_missing = 1;
+        else if( g->leader < 0 )
+            g->leader = i;
+    }
+}
+
+/*
+ * group_close - Close every counter of g
+ */
+static void group_close(struct pgroup *g)
+{
+    int i;
+
+    for( i = 0; i < NCOUNTERS; i++ )
+        if( g->fd[i] >= 0 )
+            close( g->fd[i] );
+}
+
+static inline void group_on(struct pgroup *g)
+{
+    if( g->leader >= 0 )
+        ioctl( g->fd[g->leader], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP );
+}
+
+static inline void group_off(struct pgroup *g)
+{
+    if( g->leader >= 0 )
+        ioctl( g->fd[g->leader], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP );
+}
+
+/*
+ * group_read - Read g into val and valid, scaled up if the counters had to
+ *              share the PMU with others, and reset it
+ */
+static void group_read(struct pgroup *g, double *val, int *valid)
+{
+    struct {
+        unsigned long long nr, enabled, running;
+        unsigned long long v[NCOUNTERS];
+    } buf;
+    double scale;
+    int i, k;
+
+    memset( valid, 0, NCOUNTERS * sizeof( *valid ) );
+    if( g->leader < 0 || read( g->fd[g->leader], &buf, sizeof( buf ) ) <= 0 || !buf.running )
+        return;
+    scale = (double)buf.enabled / buf.running;
+    for( i = k = 0; i < NCOUNTERS && k < (int)buf.nr; i++ )
+        if( g->fd[i] >= 0 ) {
+            val[i] = buf.v[k++] * scale;
+            valid[i] = 1;
+        }
+    ioctl( g->fd[g->leader], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP );
+}
+
+/*
+ * group_overhead - Counts for switching g on and off once with nothing
+ *                  in between, measured as the average over many tries
+ */
+static void group_overhead(struct pgroup *g, double *val)
+{
+    int valid[NCOUNTERS];
+    int i;
+
+    group_read( g, val, valid );    /* reset */
+    for( i = 0; i < 1000; i++ ) {
+        group_on( g );
+        group_off( g );
+    }
+    group_read( g, val, valid );
+    for( i = 0; i < NCOUNTERS; i++ )
+        val[i] = valid[i] ? val[i] / 1000 : 0;
+}
+
+/*
+ * replay - Run the whole trace against a fresh heap set up for pol
+ */
+static void replay(struct policy *pol)
+{
+    struct timespec t0, t1;
+    struct pgroup group[NOPTYPES];
+    double overhead[NCOUNTERS];
+    mm_heap_t *h;
+    void **ptr;
+    size_t *size;
+    size_t live = 0;
+    unsigned long long trail = 0;
+    long i;
+    int k;
+
+    if( perf ) {
+        for( i = 0; i < NOPTYPES; i++ )
+            group_open( &group[i] );
+        group_overhead( &group[OP_MALLOC], overhead );
+    }
+
+    ptr = calloc( trace.num_ids, sizeof( *ptr ) );
+    size = calloc( trace.num_ids, sizeof( *size ) );
+    if( pol->base )
+        h = mm_heap_create_at( pol->base, maxheap, MM_HEAP_RESERVE );
+    else
+        h = mm_heap_create_ex( maxheap, MM_HEAP_RESERVE );
+    if( !ptr || !size || !h || mm_heap_configure( h, &pol->cfg ) < 0 ||
+        ( predict && mm_heap_predict( h, predict ) < 0 ) ) {
+        pol->failed = 1;
+        goto out;
+    }
+
+    clock_gettime( CLOCK_MONOTONIC, &t0 );
+    for( i = 0; i < trace.num_ops; i++ ) {
+        struct op *o = &trace.ops[i];
+        void *p;
+
+        switch( o->type ) {
+        case 'a':
+            if( perf )
+                group_on( &group[OP_MALLOC] );
+            if( predict )
+                p = mm_heap_malloc_site( h, o->size, (void *)( o->site + 2 ) );
+            else if( lifetime_split )
+                p = mm_heap_malloc_hint( h, o->size, o->life >= 0 && o->life < lifetime_split ?
+                                         MM_SHORT_LIVED : MM_LONG_LIVED );
+            else
+                p = mm_heap_malloc( h, o->size );
+            if( perf )
+                group_off( &group[OP_MALLOC] );
+            if( p == NULL && o->size ) {
+                pol->failed = 1;
+                goto out;
+            }
+            pol->count[OP_MALLOC].ops++;
+            if( pol->base )
+                trail = ( trail ^ (size_t)p ) * 1099511628211ULL;
+            ptr[o->id] = p;
+            size[o->id] = o->size;
+            live += o->size;
+            break;
+        case 'r':
+            if( perf )
+                group_on( &group[OP_REALLOC] );
+            p = mm_heap_realloc( h, ptr[o->id], o->size );
+            if( perf )
+                group_off( &group[OP_REALLOC] );
+            if( p == NULL && o->size ) {
+                pol->failed = 1;
+                goto out;
+            }
+            pol->count[OP_REALLOC].ops++;
+            if( pol->base )
+                trail = ( trail ^ (size_t)p ) * 1099511628211ULL;
+            ptr[o->id] = p;
+            live += o->size - size[o->id];
+            size[o->id] = o->size;
+            break;
+        case 'f':
+            if( perf )
+                group_on( &group[OP_FREE] );
+            mm_heap_free( h, ptr[o->id] );
+            if( perf )
+                group_off( &group[OP_FREE] );
+            pol->count[OP_FREE].ops++;
+            ptr[o->id] = NULL;
+            live -= size[o->id];
+            size[o->id] = 0;
+            break;
+        }
+        if( live > pol->peak_payload )
+            pol->peak_payload = live;
+    }
+    clock_gettime( CLOCK_MONOTONIC, &t1 );
+    pol->secs = ( t1.tv_sec - t0.tv_sec ) + ( t1.tv_nsec - t0.tv_nsec ) / 1e9;
+    mm_heap_stats( h, &pol->st );
+    if( pol->base )
+        pol->digest = mm_heap_digest( h ) ^ trail;
+
+    if( perf )
+        for( i = 0; i < NOPTYPES; i++ ) {
+            struct opcount *oc = &pol->count[i];
+
+            group_read( &group[i], oc->val, oc->valid );
+            for( k = 0; k < NCOUNTERS; k++ )
+                if( oc->valid[k] )
+                    oc->val[k] = MAX( oc->val[k] - overhead[k] * oc->ops, 0 );
+        }
+
+out:
+    if( perf )
+        for( i = 0; i < NOPTYPES; i++ )
+            group_close( &group[i] );
+    if( h )
+        mm_heap_destroy( h );
+    free( ptr );
+    free( size );
+}
+
+/*
+ * worker - Replay policies until none are left; with -R replay each one
+ *          a second time at the same base and compare the digests
+ */
+static void *worker(void *arg)
+{
+    struct policy again;
+    int i;
+
+    (void)arg;
+    while( ( i = __atomic_fetch_add( &next_policy, 1, __ATOMIC_RELAXED ) ) < npolicies ) {
+        replay( &policies[i] );
+        if( !fixed_base || policies[i].failed )
+            continue;
+        memset( &again, 0, sizeof( again ) );
+        again.cfg = policies[i].cfg;
+        again.base = policies[i].base;
+        replay( &again );
+        policies[i].repro = !again.failed && again.digest == policies[i].digest;
+    }
+    return NULL;
+}
+
+/*
+ * print_counters - Per operation hardware counts for every policy
+ */
+static void print_counters(void)
+{
+    int i, t, k;
+
+    if( perf_missing )
+        fprintf( stderr, "mmeval: some hardware counters are not available\n" );
+    printf( "\n%-36s %-8s %10s", "per operation", "op", "count" );
+    for( k = 0; k < NCOUNTERS; k++ )
+        printf( " %10s", counters[k].name );
+    printf( "\n" );
+
+    for( i = 0; i < npolicies; i++ ) {
+        struct policy *pol = &policies[i];
+
+        if( pol->failed )
+            continue;
+        for( t = 0; t < NOPTYPES; t++ ) {
+            struct opcount *oc = &pol->count[t];
+
+            if( !oc->ops )
+                continue;
+            printf( "%-36s %-8s %10llu", t ? "" : pol->name, op_names[t], oc->ops );
+            for( k = 0; k < NCOUNTERS; k++ )
+                if( oc->valid[k] )
+                    printf( " %10.2f", oc->val[k] / oc->ops );
+                else
+                    printf( " %10s", "-" );
+            printf( "\n" );
+        }
+    }
+}
+
+/*
+ * now - Monotonic time in seconds
+ */
+static double now(void)
+{
+    struct timespec t;
+
+    clock_gettime( CLOCK_MONOTONIC, &t );
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/*
+ * rnd - Next number from the xorshift generator at *s, which must not be 0
+ */
+static unsigned long long rnd(unsigned long long *s)
+{
+    *s ^= *s << 13;
+    *s ^= *s >> 7;
+    *s ^= *s << 17;
+    return *s;
+}
+
+/*
+ * bench_heaps - NSUB subsystems take turns allocating and freeing blocks
+ *               of 16 to 512 bytes, first all in one shared heap, then
+ *               each in a heap of its own. Tearing a subsystem down means
+ *               freeing each of its blocks in the shared heap, but just
+ *               destroying its heap otherwise.
+ */
+static void bench_heaps(long n)
+{
+    enum { NSUB = 8, NSLOT = 1024 };
+    static void *slot[NSUB][NSLOT];
+    mm_heap_t *heap[NSUB];
+    unsigned long long seed, r;
+    struct mm_stats st;
+    double t0, t1, t2, t3;
+    size_t size;
+    long i;
+    int k, j, shared;
+
+    printf( "%-12s %12s %20s %12s\n", "heaps", "ops/sec", "teardown/subsystem", "heap bytes" );
+    for( shared = 1; shared >= 0; shared-- ) {
+        memset( slot, 0, sizeof( slot ) );
+        for( k = 0; k < NSUB; k++ )
+            if( ( heap[k] = shared && k ? heap[0] : mm_heap_create_ex( maxheap, MM_HEAP_RESERVE ) ) == NULL ) {
+                fprintf( stderr, "mmeval: cannot create a heap\n" );
+                exit( 1 );
+            }
+
+        seed = 1;
+        t0 = now();
+        for( i = 0; i < n; i++ )
+            for( k = 0; k < NSUB; k++ ) {
+                r = rnd( &seed );
+                j = r % NSLOT;
+                if( slot[k][j] ) {
+                    mm_heap_free( heap[k], slot[k][j] );
+                    slot[k][j] = NULL;
+                }
+                else if( ( slot[k][j] = mm_heap_malloc( heap[k], 16 + ( r >> 32 ) % 497 ) ) != NULL )
+                    memset( slot[k][j], k, 16 );
+            }
+        t1 = now();
+        for( size = 0, k = 0; k < ( shared ? 1 : NSUB ); k++ ) {
+            mm_heap_stats( heap[k], &st );
+            size += st.heapsize;
+        }
+
+        /* only the teardown itself is timed, not the heap walks above */
+        t2 = now();
+        for( k = 0; k < NSUB; k++ )
+            if( shared ) {
+                for( j = 0; j < NSLOT; j++ )
+                    mm_heap_free( heap[k], slot[k][j] );
+            }
+            else
+                mm_heap_destroy( heap[k] );
+        t3 = now();
+        if( shared )
+            mm_heap_destroy( heap[0] );
+        printf( "%-12s %12.0f %18.1fus %12zu\n", shared ? "shared" : "per-heap",
+                n * NSUB / ( t1 - t0 ), ( t3 - t2 ) / NSUB * 1e6, size );
+    }
+}
+
+/*
+ * churn - n steps of random allocation and freeing over the nslot
+ *         blocks in slot: mostly 16 to 512 bytes, one in 64 between
+ *         64 KiB and 512 KiB, big enough to make the heap grow and trim
+ */
+static void churn(mm_heap_t *h, void **slot, int nslot, long n, unsigned long long *seed)
+{
+    unsigned long long r;
+    size_t size;
+    long i;
+    int j;
+
+    for( i = 0; i < n; i++ ) {
+        r = rnd( seed );
+        j = r % nslot;
+        if( slot[j] ) {
+            mm_heap_free( h, slot[j] );
+            slot[j] = NULL;
+            continue;
+        }
+        size = ( r >> 32 ) % 64 ? 16 + ( r >> 40 ) % 497 : ( 64 << 10 ) + ( r >> 40 ) % ( 448 << 10 );
+        if( ( slot[j] = mm_heap_malloc( h, size ) ) != NULL )
+            memset( slot[j], 1, 16 );
+    }
+}
+
+/*
+ * bench_buffer - The same churn in a heap over a prefaulted caller buffer
+ *                and in reserve and segmented heaps, which commit, trim,
+ *                map and unmap as they go. Only the steady state after a
+ *                warm-up of n steps is measured.
+ */
+static void bench_buffer(long n)
+{
+    enum { NSLOT = 256, BUFSIZE = 64 << 20 };
+    static const char *names[] = { "buffer", "reserve", "segmented" };
+    static void *slot[NSLOT];
+    struct rusage ru0, ru1;
+    unsigned long long seed = 1;
+    mm_heap_t *h;
+    char *buf;
+    double t0, t1;
+    int kind;
+
+    if( ( buf = mmap( NULL, BUFSIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 ) ) == MAP_FAILED ) {
+        perror( "mmap" );
+        exit( 1 );
+    }
+    memset( buf, 0, BUFSIZE );
+    printf( "%-12s %12s %12s %12s\n", "buffer", "ops/sec", "faults", "sys ms" );
+    for( kind = 0; kind < 3; kind++ ) {
+        h = kind == 0 ? mm_heap_create_in_buffer( buf, BUFSIZE ) :
+            mm_heap_create_ex( kind == 1 ? maxheap : 0, kind == 1 ? MM_HEAP_RESERVE : MM_HEAP_SEGMENTED );
+        if( !h ) {
+            fprintf( stderr, "mmeval: cannot create a heap\n" );
+            exit( 1 );
+        }
+        memset( slot, 0, sizeof( slot ) );
+        churn( h, slot, NSLOT, n, &seed );
+        getrusage( RUSAGE_SELF, &ru0 );
+        t0 = now();
+        churn( h, slot, NSLOT, n, &seed );
+        t1 = now();
+        getrusage( RUSAGE_SELF, &ru1 );
+        printf( "%-12s %12.0f %12ld %12.1f\n", names[kind], n / ( t1 - t0 ), ru1.ru_minflt - ru0.ru_minflt,
+                ( ru1.ru_stime.tv_sec - ru0.ru_stime.tv_sec ) * 1e3 + ( ru1.ru_stime.tv_usec - ru0.ru_stime.tv_usec ) / 1e3 );
+        mm_heap_destroy( h );   /* a buffer heap is just abandoned */
+    }
+    munmap( buf, BUFSIZE );
+}
+
+/*
+ * bench_release - Grow a heap to n MiB in 256 KiB blocks, touching each,
+ *                 then free every block in a random order, and finally
+ *                 time a block that goes back and forth across the
+ *                 boundary of the last segment (or past the trim
+ *                 threshold) a thousand times
+ */
+static void bench_release(long n)
+{
+    enum { BLOCK = 256 << 10 };
+    static const char *names[] = { "segmented", "reserve", "region" };
+    static const unsigned flags[] = { MM_HEAP_SEGMENTED, MM_HEAP_RESERVE, 0 };
+    long nblocks = n * ( ( 1 << 20 ) / BLOCK ), i, j;
+    size_t maxsize = ( (size_t)n << 20 ) + ( (size_t)n << 16 ) + ( 1 << 20 );    /* with room for the tags */
+    unsigned long long seed = 1;
+    struct mm_stats st;
+    mm_heap_t *h;
+    void **blk, *p;
+    double t0, t1, t2, t3;
+    int kind;
+
+    if( ( blk = malloc( nblocks * sizeof( *blk ) ) ) == NULL ) {
+        perror( "malloc" );
+        exit( 1 );
+    }
+    printf( "%-12s %10s %10s %14s %10s\n", "release", "grow ms", "free ms", "heap after", "cycle us" );
+    for( kind = 0; kind < 3; kind++ ) {
+        if( ( h = mm_heap_create_ex( kind ? maxsize : 0, flags[kind] ) ) == NULL ) {
+            printf( "%-12s %10s\n", names[kind], "failed" );
+            continue;
+        }
+        t0 = now();
+        for( i = 0; i < nblocks; i++ )
+            if( ( blk[i] = mm_heap_malloc( h, BLOCK ) ) != NULL )
+                *(char *)blk[i] = 1;
+        t1 = now();
+        for( i = nblocks - 1; i > 0; i-- ) {
+            j = rnd( &seed ) % ( i + 1 );
+            p = blk[i];
+            blk[i] = blk[j];
+            blk[j] = p;
+        }
+        for( i = 0; i < nblocks; i++ )
+            mm_heap_free( h, blk[i] );
+        t2 = now();
+        mm_heap_stats( h, &st );
+        for( i = 0; i < 1000; i++ ) {
+            if( ( p = mm_heap_malloc( h, 2 * BLOCK ) ) != NULL )
+                *(char *)p = 1;
+            mm_heap_free( h, p );
+        }
+        t3 = now();
+        printf( "%-12s %10.1f %10.1f %14zu %10.2f\n", names[kind], ( t1 - t0 ) * 1e3, ( t2 - t1 ) * 1e3,
+                st.heapsize, ( t3 - t2 ) * 1e3 );
+        mm_heap_destroy( h );
+    }
+    free( blk );
+}
+
+/*
+ * bench_grow - Grow the memlib default heap, a region heap and a reserve
+ *              heap by n MiB of 64-byte blocks, then free them all. The
+ *              memlib heap is limited by memlib's own maximum size.
+ */
+static void bench_grow(long n)
+{
+    static const char *names[] = { "memlib", "region", "reserve" };
+    long nblocks = ( n << 20 ) / 64, i;
+    struct mm_stats st;
+    mm_heap_t *h;
+    void **blk;
+    double t0, t1, t2;
+    int kind;
+
+    if( ( blk = malloc( nblocks * sizeof( *blk ) ) ) == NULL ) {
+        perror( "malloc" );
+        exit( 1 );
+    }
+    mem_init();
+    printf( "%-12s %10s %10s %10s %14s\n", "grow", "grow ms", "ns/alloc", "free ms", "heap after" );
+    for( kind = 0; kind < 3; kind++ ) {
+        h = NULL;
+        if( kind == 0 && mm_init() == -1 )
+            continue;
+        if( kind && ( h = mm_heap_create_ex( ( (size_t)n << 21 ) + ( 1 << 20 ), kind == 2 ? MM_HEAP_RESERVE : 0 ) ) == NULL ) {
+            printf( "%-12s %10s\n", names[kind], "failed" );
+            continue;
+        }
+        t0 = now();
+        for( i = 0; i < nblocks; i++ )
+            if( ( blk[i] = h ? mm_heap_malloc( h, 64 ) : mm_malloc( 64 ) ) == NULL )
+                break;
+        t1 = now();
+        if( i < nblocks ) {
+            printf( "%-12s %10s after %ld MiB\n", names[kind], "full", i * 64 >> 20 );
+            nblocks = i;    /* the other backends grow as far */
+        }
+        while( i-- > 0 )
+            if( h )
+                mm_heap_free( h, blk[i] );
+            else
+                mm_free( blk[i] );
+        t2 = now();
+        if( h )
+            mm_heap_stats( h, &st );
+        else
+            mm_stats( &st );
+        printf( "%-12s %10.1f %10.1f %10.1f %14zu\n", names[kind], ( t1 - t0 ) * 1e3,
+                nblocks ? ( t1 - t0 ) / nblocks * 1e9 : 0, ( t2 - t1 ) * 1e3, st.heapsize );
+        if( h )
+            mm_heap_destroy( h );
+    }
+    free( blk );
+}
+
+/*
+ * bench_tlb - Fill a reserve heap with n MiB of 64 to 256 byte blocks and
+ *             read one word of each, in a random order, four times over.
+ *             dTLB misses come from the hardware counters where there
+ *             are any.
+ */
+static void bench_tlb(long n)
+{
+    enum { ROUNDS = 4 };
+    unsigned long long seed = 1;
+    double val[NCOUNTERS], t0, t1;
+    int valid[NCOUNTERS];
+    struct pgroup g;
+    mm_heap_t *h;
+    void **blk, *p;
+    long nblocks, i, j, r;
+    size_t bytes;
+    volatile long sum = 0;
+    int huge;
+
+    printf( "%-12s %10s %12s\n", "tlb", "ns/read", "dTLB/read" );
+    for( huge = 0; huge < 2; huge++ ) {
+        h = mm_heap_create_ex( ( (size_t)n << 21 ) + ( 4 << 20 ), MM_HEAP_RESERVE | ( huge ? MM_HEAP_HUGEPAGE : 0 ) );
+        nblocks = ( n << 20 ) / 64;
+        if( !h || ( blk = malloc( nblocks * sizeof( *blk ) ) ) == NULL ) {
+            printf( "%-12s %10s\n", huge ? "hugepage" : "normal", "failed" );
+            if( h )
+                mm_heap_destroy( h );
+            continue;
+        }
+        for( i = 0, bytes = 0; bytes < (size_t)n << 20; i++ ) {
+            r = rnd( &seed );
+            if( ( blk[i] = mm_heap_malloc( h, 64 + r % 193 ) ) == NULL )
+                break;
+            *(long *)blk[i] = i;
+            bytes += 64 + r % 193;
+        }
+        nblocks = i;
+        for( i = nblocks - 1; i > 0; i-- ) {
+            j = rnd( &seed ) % ( i + 1 );
+            p = blk[i];
+            blk[i] = blk[j];
+            blk[j] = p;
+        }
+
+        group_open( &g );
+        group_read( &g, val, valid );
+        t0 = now();
+        group_on( &g );
+        for( r = 0; r < ROUNDS; r++ )
+            for( i = 0; i < nblocks; i++ )
+                sum += *(long *)blk[i];
+        group_off( &g );
+        t1 = now();
+        group_read( &g, val, valid );
+        group_close( &g );
+        printf( "%-12s %10.2f", huge ? "hugepage" : "normal", ( t1 - t0 ) / ( ROUNDS * nblocks ) * 1e9 );
+        if( valid[DTLB_COUNTER] )
+            printf( " %12.3f\n", val[DTLB_COUNTER] / ( ROUNDS * nblocks ) );
+        else
+            printf( " %12s\n", "-" );
+        free( blk );
+        mm_heap_destroy( h );
+    }
+}
+
+/*
+ * cmp_double - qsort order of doubles
+ */
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return ( x > y ) - ( x < y );
+}
+
+/*
+ * bench_first - Time each of the first n requests to a new reserve heap,
+ *               a request being an allocation of 4 to 64 KiB that is
+ *               written in full and kept. The heap either starts empty
+ *               or has the space reserved, and maybe prefaulted, first.
+ */
+static void bench_first(long n)
+{
+    static const char *names[] = { "none", "reserve", "prefault", "prefault+lock" };
+    static const unsigned flags[] = { 0, 0, MM_RESERVE_PREFAULT, MM_RESERVE_PREFAULT | MM_RESERVE_LOCK };
+    unsigned long long seed;
+    double *lat, t0, sum;
+    size_t size, total;
+    mm_heap_t *h;
+    void *p;
+    long i;
+    int kind;
+
+    if( ( lat = malloc( n * sizeof( *lat ) ) ) == NULL ) {
+        perror( "malloc" );
+        exit( 1 );
+    }
+    total = (size_t)n * ( 68 << 10 );   /* more than the requests take */
+    printf( "%-14s %10s %10s %10s %10s\n", "first", "mean us", "p50 us", "p99 us", "max us" );
+    for( kind = 0; kind < 4; kind++ ) {
+        if( ( h = mm_heap_create_ex( 2 * total, MM_HEAP_RESERVE ) ) == NULL ||
+            ( kind && mm_heap_reserve( h, total, flags[kind] ) == -1 ) ) {
+            printf( "%-14s %10s\n", names[kind], "failed" );
+            if( h )
+                mm_heap_destroy( h );
+            continue;
+        }
+        seed = 1;
+        for( i = 0, sum = 0; i < n; i++ ) {
+            size = ( 4 << 10 ) + rnd( &seed ) % ( 60 << 10 );
+            t0 = now();
+            if( ( p = mm_heap_malloc( h, size ) ) != NULL )
+                memset( p, 1, size );
+            lat[i] = ( now() - t0 ) * 1e6;
+            sum += lat[i];
+        }
+        qsort( lat, n, sizeof( *lat ), cmp_double );
+        printf( "%-14s %10.2f %10.2f %10.2f %10.2f\n", names[kind], sum / n,
+                lat[n / 2], lat[n * 99 / 100], lat[n - 1] );
+        mm_heap_destroy( h );
+    }
+    free( lat );
+}
+
+/*
+ * A node of the structure bench_restore builds: hash chains of keyed
+ * records of assorted sizes.
+ */
+struct node {
+    struct node *next;
+    unsigned long long key;
+};
+
+/*
+ * walk_nodes - Sum the keys of every chain of a bucket array
+ */
+static unsigned long long walk_nodes(struct node **bucket, long nbucket)
+{
+    unsigned long long sum = 0;
+    struct node *p;
+    long i;
+
+    for( i = 0; i < nbucket; i++ )
+        for( p = bucket[i]; p; p = p->next )
+            sum += p->key;
+    return sum;
+}
+
+/*
+ * bench_restore - Build hash chains of n nodes in a heap, checkpoint and
+ *                 destroy it, then restore it and walk every chain. The
+ *                 build is what a program without checkpoints would redo
+ *                 at every start; restore and walk is what replaces it.
+ */
+static void bench_restore(long n)
+{
+    unsigned long long seed = 1, key, sum, check;
+    long i = 0, nbucket = n / 4 + 1;
+    double t0, build, ckpt, restore, walk;
+    struct node **bucket, *p;
+    char path[64];
+    mm_heap_t *h;
+    size_t size;
+    int fd;
+
+    snprintf( path, sizeof( path ), "/tmp/mmeval.%ld.ckpt", (long)getpid() );
+    if( ( h = mm_heap_create( (size_t)n * 160 + nbucket * sizeof( *bucket ) + ( 1 << 20 ) ) ) == NULL ) {
+        printf( "restore: cannot create a heap for %ld nodes\n", n );
+        return;
+    }
+    t0 = now();
+    if( ( bucket = mm_heap_malloc( h, nbucket * sizeof( *bucket ) ) ) == NULL )
+        goto full;
+    memset( bucket, 0, nbucket * sizeof( *bucket ) );
+    for( i = 0, check = 0; i < n; i++ ) {
+        key = rnd( &seed );
+        size = sizeof( struct node ) + key % 112;
+        if( ( p = mm_heap_malloc( h, size ) ) == NULL )
+            goto full;
+        memset( p + 1, (int)key, size - sizeof( *p ) );
+        p->key = key;
+        p->next = bucket[key % nbucket];
+        bucket[key % nbucket] = p;
+        check += key;
+    }
+    build = now() - t0;
+
+    t0 = now();
+    if( mm_heap_checkpoint( h, path ) == -1 ) {
+        printf( "restore: checkpoint to %s failed\n", path );
+        mm_heap_destroy( h );
+        return;
+    }
+    ckpt = now() - t0;
+    mm_heap_destroy( h );
+
+    /* drop the file from the page cache if we may, for a cold start */
+    if( ( fd = open( path, O_RDONLY ) ) != -1 ) {
+        fdatasync( fd );
+        posix_fadvise( fd, 0, 0, POSIX_FADV_DONTNEED );
+        close( fd );
+    }
+    t0 = now();
+    h = mm_heap_restore( path );
+    restore = now() - t0;
+    unlink( path );
+    if( h == NULL ) {
+        printf( "restore: restore from %s failed\n", path );
+        return;
+    }
+    t0 = now();
+    sum = walk_nodes( bucket, nbucket );
+    walk = now() - t0;
+    mm_heap_destroy( h );
+
+    printf( "%-14s %10s\n", "restore", "ms" );
+    printf( "%-14s %10.2f\n", "build", build * 1e3 );
+    printf( "%-14s %10.2f\n", "checkpoint", ckpt * 1e3 );
+    printf( "%-14s %10.2f\n", "restore", restore * 1e3 );
+    printf( "%-14s %10.2f%s\n", "walk", walk * 1e3, sum == check ? "" : " (keys differ)" );
+    printf( "%-14s %10.2f\n", "restore+walk", ( restore + walk ) * 1e3 );
+    return;
+
+ full:
+    printf( "restore: heap full after %ld nodes\n", i );
+    mm_heap_destroy( h );
+}
+
+/*
+ * bench_append - NBUILD string builders take random turns appending 1 to
+ *                64 bytes, with a small long-lived block allocated every
+ *                so often between them; a builder that reaches 64 KiB is
+ *                freed and starts over. Each builder grows its buffer
+ *                to exactly what it holds with mm_heap_realloc ("realloc"),
+ *                with malloc, copy and free, i.e. a move on every growth
+ *                ("move"), or by doubling its capacity itself ("double").
+ */
+static void bench_append(long n)
+{
+    enum { NBUILD = 64, MAXLEN = 64 << 10, NJUNK = 1 << 16 };
+    static const char *names[] = { "realloc", "move", "double" };
+    static char chunk[64];
+    struct { char *buf; size_t len, cap; } b[NBUILD];
+    unsigned long long seed, r, grows, copies;
+    size_t add, cap, heapsize;
+    struct mm_stats st;
+    mm_heap_t *h;
+    double t0, t;
+    char *p;
+    long i;
+    int how, k, njunk;
+
+    memset( chunk, 'x', sizeof( chunk ) );
+    printf( "%-14s %12s %12s %12s %12s\n", "append", "grows", "copies", "ms", "heap bytes" );
+    for( how = 0; how < 3; how++ ) {
+        if( ( h = mm_heap_create_ex( maxheap, MM_HEAP_RESERVE ) ) == NULL ) {
+            fprintf( stderr, "mmeval: cannot create a heap\n" );
+            exit( 1 );
+        }
+        memset( b, 0, sizeof( b ) );
+        seed = 1;
+        grows = copies = heapsize = 0;
+        njunk = 0;
+        t0 = now();
+        for( i = 0; i < n; i++ ) {
+            r = rnd( &seed );
+            k = r % NBUILD;
+            add = 1 + ( r >> 8 ) % sizeof( chunk );
+            if( b[k].len + add > MAXLEN ) {
+                mm_heap_free( h, b[k].buf );
+                memset( &b[k], 0, sizeof( b[k] ) );
+            }
+            if( b[k].len + add > b[k].cap ) {
+                cap = how == 2 ? MAX( 2 * b[k].cap, 64 ) : b[k].len + add;
+                if( how == 1 ) {
+                    if( ( p = mm_heap_malloc( h, cap ) ) != NULL && b[k].buf ) {
+                        memcpy( p, b[k].buf, b[k].len );
+                        mm_heap_free( h, b[k].buf );
+                    }
+                }
+                else
+                    p = mm_heap_realloc( h, b[k].buf, cap );
+                if( p == NULL ) {
+                    fprintf( stderr, "mmeval: heap full\n" );
+                    exit( 1 );
+                }
+                grows++;
+                copies += b[k].buf && p != b[k].buf;
+                b[k].buf = p;
+                b[k].cap = cap;
+            }
+            memcpy( b[k].buf + b[k].len, chunk, add );
+            b[k].len += add;
+            if( ( r >> 20 ) % 16 == 0 && njunk < NJUNK && mm_heap_malloc( h, 16 + ( r >> 32 ) % 113 ) )
+                njunk++;
+            if( ( r >> 24 ) % 1024 == 0 ) {
+                mm_heap_stats( h, &st );
+                heapsize = MAX( heapsize, st.heapsize );
+            }
+        }
+        t = now() - t0;
+        printf( "%-14s %12llu %12llu %12.1f %12zu\n", names[how], grows, copies, t * 1e3, heapsize );
+        mm_heap_destroy( h );
+    }
+}
+
+/*
+ * The thread bench_move runs alongside the moves: it chases pointers
+ * around a working set small enough to stay in the cache until stop is
+ * set, counting its steps.
+ */
+struct walker {
+    void **ring;
+    volatile int stop;
+    unsigned long long steps;
+};
+
+/*
+ * walk - Body of the walker thread
+ */
+static void *walk(void *arg)
+{
+    struct walker *w = arg;
+    unsigned long long steps = 0;
+    void **p = w->ring;
+    int i;
+
+    while( !w->stop ) {
+        for( i = 0; i < 1024; i++ )
+            p = *p;
+        steps += 1024;
+    }
+    w->steps = steps + ( p == NULL );
+    return NULL;
+}
+
+/*
+ * walk_for - Run a walker while fn does its moves, or for secs if fn is
+ *            NULL, and return the walker's ns per step
+ */
+static double walk_for(void **ring, void (*fn)(void *, double *), void *arg, double *secs)
+{
+    struct walker w;
+    pthread_t tid;
+    double t0, t;
+
+    w.ring = ring;
+    w.stop = 0;
+    w.steps = 0;
+    if( pthread_create( &tid, NULL, walk, &w ) ) {
+        perror( "pthread_create" );
+        exit( 1 );
+    }
+    t0 = now();
+    if( fn )
+        fn( arg, secs );
+    else
+        while( now() - t0 < *secs )
+            ;
+    t = now() - t0;
+    w.stop = 1;
+    pthread_join( tid, NULL );
+    return w.steps ? t * 1e9 / w.steps : 0;
+}
+
+/* one way of moving blocks in bench_move */
+struct mover {
+    const char *name;
+    mm_heap_t *h;
+    size_t size;
+    int copy;               /* malloc, memcpy and free instead of realloc */
+    int moved;              /* reallocs that did move the block */
+};
+
+#define NMOVES 32
+
+/*
+ * do_moves - NMOVES times allocate and fill a block, pin it with a small
+ *            block behind it so it cannot grow in place, and grow it by
+ *            half; *secs gets the time spent moving
+ */
+static void do_moves(void *arg, double *secs)
+{
+    struct mover *m = arg;
+    char *p, *q, *pin;
+    double t0;
+    int i;
+
+    *secs = 0;
+    for( i = 0; i < NMOVES; i++ ) {
+        if( ( p = mm_heap_malloc( m->h, m->size ) ) == NULL ||
+            ( pin = mm_heap_malloc( m->h, 64 ) ) == NULL ) {
+            fprintf( stderr, "mmeval: heap full\n" );
+            exit( 1 );
+        }
+        memset( p, i, m->size );
+        t0 = now();
+        if( m->copy ) {
+            if( ( q = mm_heap_malloc( m->h, m->size + m->size/2 ) ) != NULL ) {
+                memcpy( q, p, m->size );
+                mm_heap_free( m->h, p );
+            }
+        }
+        else
+            q = mm_heap_realloc( m->h, p, m->size + m->size/2 );
+        *secs += now() - t0;
+        if( q == NULL ) {
+            fprintf( stderr, "mmeval: heap full\n" );
+            exit( 1 );
+        }
+        m->moved += q != p;
+        if( q[m->size - 1] != (char)i )
+            fprintf( stderr, "mmeval: %s lost the payload\n", m->name );
+        mm_heap_free( m->h, pin );
+        mm_heap_free( m->h, q );
+    }
+}
+
+/*
+ * bench_move - Move blocks of n MiB with realloc: in a mapped heap, where
+ *              page-congruent moves are remapped ("remap"), in a heap
+ *              over a caller buffer, where they use non-temporal stores
+ *              ("stream"), and by hand with a cached memcpy ("memcpy").
+ *              A second thread chases pointers around a 1 MiB working
+ *              set meanwhile; its ns per step against an idle run shows
+ *              how much of its set each kind of move evicts.
+ */
+static void bench_move(long n)
+{
+    enum { HOT = 1 << 20, LINE = 64 };
+    struct mover mv[3];
+    size_t size = (size_t)n << 20, len = 4 * size + ( 4 << 20 ), nline = HOT / LINE, i, j, t;
+    size_t *perm;
+    void **ring;
+    char *buf;
+    double secs, ns, idle;
+    int k;
+
+    ring = malloc( HOT );
+    perm = malloc( nline * sizeof( *perm ) );
+    buf = mmap( NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+    if( !ring || !perm || buf == MAP_FAILED ) {
+        perror( "mmeval" );
+        exit( 1 );
+    }
+    for( i = 0; i < nline; i++ )
+        perm[i] = i;
+    for( i = nline - 1; i > 0; i-- ) {
+        j = rand() % ( i + 1 );
+        t = perm[i];
+        perm[i] = perm[j];
+        perm[j] = t;
+    }
+    for( i = 0; i < nline; i++ )
+        ring[perm[i] * ( LINE / sizeof( void * ) )] = &ring[perm[( i + 1 ) % nline] * ( LINE / sizeof( void * ) )];
+    free( perm );
+
+    memset( mv, 0, sizeof( mv ) );
+    mv[0].name = "remap";
+    mv[0].h = mm_heap_create_ex( len, MM_HEAP_RESERVE );
+    mv[1].name = "stream";
+    mv[1].h = mm_heap_create_in_buffer( buf, len );
+    mv[2].name = "memcpy";
+    mv[2].h = mm_heap_create_ex( len, MM_HEAP_RESERVE );
+    mv[2].copy = 1;
+
+    secs = 0.2;
+    idle = walk_for( ring, NULL, NULL, &secs );
+    printf( "%-14s %10s %10s %12s %12s\n", "move", "moved", "GB/s", "walk ns", "slowdown" );
+    printf( "%-14s %10s %10s %12.2f\n", "idle", "", "", idle );
+    for( k = 0; k < 3; k++ ) {
+        if( mv[k].h == NULL ) {
+            printf( "%-14s %10s\n", mv[k].name, "failed" );
+            continue;
+        }
+        mv[k].size = size;
+        ns = walk_for( ring, do_moves, &mv[k], &secs );
+        printf( "%-14s %7d/%-2d %10.2f %12.2f %11.2fx\n", mv[k].name, mv[k].moved, NMOVES,
+                secs > 0 ? (double)size * NMOVES / secs / 1e9 : 0, ns, idle > 0 ? ns / idle : 0 );
+        mm_heap_destroy( mv[k].h );
+    }
+    munmap( buf, len );
+    free( ring );
+}
+
+/*
+ * bench_vector - NVEC vectors of 12-byte elements take random pushes; a
+ *                full vector grows by half its capacity, and one that
+ *                reaches MAXLEN elements is freed and starts over. The
+ *                capacity is what was asked for ("asked"), what
+ *                mm_usable_size reports for the block ("usable"), or the
+ *                request is rounded up front with mm_heap_malloc_size_hint
+ *                ("hint"). Each runs under the default policy and with
+ *                size classes, whose rounding leaves more slack.
+ */
+static void bench_vector(long n)
+{
+    enum { NVEC = 256, ELEM = 12, MAXLEN = 4096 };
+    static const char *names[] = { "asked", "usable", "hint" };
+    static const char *specs[] = { "fit=first", "classes=4" };
+    struct { char *buf; size_t len, cap; } v[NVEC];
+    unsigned long long seed, r, grows;
+    struct policy pol;
+    size_t want;
+    mm_heap_t *h;
+    double t0, t;
+    char *p;
+    long i;
+    int how, spec, k;
+
+    printf( "%-24s %12s %12s\n", "vector", "reallocs", "ms" );
+    for( spec = 0; spec < 2; spec++ )
+        for( how = 0; how < 3; how++ ) {
+            parse_policy( &pol, specs[spec] );
+            if( ( h = mm_heap_create_ex( maxheap, MM_HEAP_RESERVE ) ) == NULL ||
+                mm_heap_configure( h, &pol.cfg ) < 0 ) {
+                fprintf( stderr, "mmeval: cannot create a heap\n" );
+                exit( 1 );
+            }
+            memset( v, 0, sizeof( v ) );
+            seed = 1;
+            grows = 0;
+            t0 = now();
+            for( i = 0; i < n; i++ ) {
+                r = rnd( &seed );
+                k = r % NVEC;
+                if( v[k].len == MAXLEN ) {
+                    mm_heap_free( h, v[k].buf );
+                    memset( &v[k], 0, sizeof( v[k] ) );
+                }
+                if( v[k].len == v[k].cap ) {
+                    want = ( v[k].cap + v[k].cap/2 + 1 ) * ELEM;
+                    if( how == 2 )
+                        want = mm_heap_malloc_size_hint( h, want );
+                    if( ( p = mm_heap_realloc( h, v[k].buf, want ) ) == NULL ) {
+                        fprintf( stderr, "mmeval: heap full\n" );
+                        exit( 1 );
+                    }
+                    v[k].buf = p;
+                    v[k].cap = ( how == 1 ? mm_usable_size( p ) : want ) / ELEM;
+                    if( v[k].cap > MAXLEN )
+                        v[k].cap = MAXLEN;
+                    grows++;
+                }
+                memset( v[k].buf + v[k].len++ * ELEM, (int)r, ELEM );
+            }
+            t = now() - t0;
+            printf( "%-10s %-13s %12llu %12.1f\n", specs[spec], names[how], grows, t * 1e3 );
+            mm_heap_destroy( h );
+        }
+}
+
+/*
+ * bench_ramp - Make n allocations, or as many as fit 1 GiB, into a fresh
+ *              heap without freeing any, for three size ranges, so
+ *              nearly every one is cut from the top chunk; the C
+ *              library's malloc on the same sizes is given for reference.
+ *              Blocks are written, as a program ramping up would.
+ */
+static void bench_ramp(long n)
+{
+    static const struct { const char *name; size_t lo, hi; } mix[] = {
+        { "16-64", 16, 64 }, { "16-512", 16, 512 }, { "512-4096", 512, 4096 },
+    };
+    unsigned long long seed;
+    void **blk;
+    size_t size;
+    mm_heap_t *h;
+    double t0, t[2];
+    long i, count;
+    int m, libc;
+
+    if( ( blk = malloc( n * sizeof( *blk ) ) ) == NULL ) {
+        perror( "malloc" );
+        exit( 1 );
+    }
+    printf( "%-14s %14s %14s\n", "ramp", "mm ns/alloc", "libc ns/alloc" );
+    for( m = 0; m < 3; m++ ) {
+        count = MIN( n, (long)( ( (size_t)1 << 30 ) / mix[m].hi ) );
+        for( libc = 0; libc < 2; libc++ ) {
+            h = NULL;
+            if( !libc && ( h = mm_heap_create_ex( (size_t)count * ( mix[m].hi + 64 ) + ( 1 << 20 ), MM_HEAP_RESERVE ) ) == NULL ) {
+                fprintf( stderr, "mmeval: cannot create a heap\n" );
+                exit( 1 );
+            }
+            seed = 1;
+            t0 = now();
+            for( i = 0; i < count; i++ ) {
+                size = mix[m].lo + rnd( &seed ) % ( mix[m].hi - mix[m].lo + 1 );
+                if( ( blk[i] = libc ? malloc( size ) : mm_heap_malloc( h, size ) ) == NULL ) {
+                    fprintf( stderr, "mmeval: out of memory\n" );
+                    exit( 1 );
+                }
+                memset( blk[i], 1, 16 );
+            }
+            t[libc] = ( now() - t0 ) * 1e9 / count;
+            if( libc )
+                for( i = 0; i < count; i++ )
+                    free( blk[i] );
+            else
+                mm_heap_destroy( h );
+        }
+        printf( "%-14s %14.1f %14.1f\n", mix[m].name, t[0], t[1] );
+    }
+    free( blk );
+}
+
+/*
+ * bench_scratch - n rounds of DEPTH nested scratch buffers of 32 to 1024
+ *                 bytes, each written, then freed innermost first
+ *                 ("lifo"), which rolls the top chunk back, or outermost
+ *                 first ("fifo"). "pinned" nests like lifo but keeps a
+ *                 small block from every round alive for a while, so the
+ *                 buffers are not the last cut from the top when freed.
+ *                 The C library's malloc runs the lifo pattern for
+ *                 reference.
+ */
+static void bench_scratch(long n)
+{
+    enum { DEPTH = 8, NPIN = 1024 };
+    static const char *names[] = { "lifo", "fifo", "pinned", "libc lifo" };
+    static void *pin[NPIN];
+    unsigned long long seed;
+    void *p[DEPTH];
+    size_t size;
+    mm_heap_t *h = NULL;
+    double t0, t;
+    long i;
+    int how, d;
+
+    printf( "%-14s %12s\n", "scratch", "ns/pair" );
+    for( how = 0; how < 4; how++ ) {
+        if( how < 3 && ( h = mm_heap_create_ex( maxheap, MM_HEAP_RESERVE ) ) == NULL ) {
+            fprintf( stderr, "mmeval: cannot create a heap\n" );
+            exit( 1 );
+        }
+        memset( pin, 0, sizeof( pin ) );
+        seed = 1;
+        t0 = now();
+        for( i = 0; i < n; i++ ) {
+            for( d = 0; d < DEPTH; d++ ) {
+                size = 32 + rnd( &seed ) % 993;
+                if( ( p[d] = how < 3 ? mm_heap_malloc( h, size ) : malloc( size ) ) == NULL ) {
+                    fprintf( stderr, "mmeval: out of memory\n" );
+                    exit( 1 );
+                }
+                memset( p[d], d, 16 );
+            }
+            if( how == 2 ) {
+                mm_heap_free( h, pin[i % NPIN] );
+                pin[i % NPIN] = mm_heap_malloc( h, 48 );
+            }
+            for( d = 0; d < DEPTH; d++ )
+                if( how == 1 )
+                    mm_heap_free( h, p[d] );
+                else if( how < 3 )
+                    mm_heap_free( h, p[DEPTH - 1 - d] );
+                else
+                    free( p[DEPTH - 1 - d] );
+        }
+        t = now() - t0;
+        printf( "%-14s %12.1f\n", names[how], t * 1e9 / ( (double)n * DEPTH ) );
+        if( how < 3 )
+            mm_heap_destroy( h );
+    }
+}
+
+/*
+ * resident - Bytes of the process resident in memory
+ */
+static size_t resident(void)
+{
+    unsigned long size, rss = 0;
+    FILE *f;
+
+    if( ( f = fopen( "/proc/self/statm", "r" ) ) != NULL ) {
+        if( fscanf( f, "%lu %lu", &size, &rss ) != 2 )
+            rss = 0;
+        fclose( f );
+    }
+    return rss * sysconf( _SC_PAGESIZE );
+}
+
+/*
+ * bench_pagemap - Grow one segmented heap to 1, 2, 4 ... n GiB with
+ *                 blocks of 256 MiB that are never written, so what the
+ *                 process gains in resident memory is the page map plus
+ *                 a few pages of tags, and at each size time mm_heap_of
+ *                 on random pointers into the blocks. The heap is not
+ *                 destroyed in between, since the map keeps its nodes
+ *                 for the next heap at the same addresses.
+ */
+static void bench_pagemap(long n)
+{
+    enum { BLOCK = 256 << 20, NPTR = 1 << 16, NLOOKUP = 1 << 24 };
+    static void *ptr[NPTR];
+    unsigned long long seed = 1, r;
+    void **blk;
+    size_t rss0, rss, nblk = 0, i;
+    mm_heap_t *h;
+    double t0, t;
+    long gib, miss;
+
+    if( ( blk = malloc( ( n * 4 + 1 ) * sizeof( *blk ) ) ) == NULL ) {
+        perror( "malloc" );
+        exit( 1 );
+    }
+    if( ( h = mm_heap_create_ex( 0, MM_HEAP_SEGMENTED ) ) == NULL ) {
+        fprintf( stderr, "mmeval: cannot create a heap\n" );
+        exit( 1 );
+    }
+    rss0 = resident();
+    printf( "%-14s %12s %12s %12s\n", "pagemap GiB", "lookup ns", "map KiB", "of heap" );
+    for( gib = 1; gib <= n; gib *= 2 ) {
+        for( ; nblk < (size_t)gib * 4; nblk++ )
+            if( ( blk[nblk] = mm_heap_malloc( h, BLOCK - 64 ) ) == NULL )
+                break;
+        if( nblk < (size_t)gib * 4 ) {
+            printf( "%-14ld %12s\n", gib, "failed" );
+            break;
+        }
+        rss = resident() - rss0;
+        for( i = 0; i < NPTR; i++ ) {
+            r = rnd( &seed );
+            ptr[i] = (char *)blk[r % nblk] + ( r >> 32 ) % ( BLOCK - 64 );
+        }
+        t0 = now();
+        for( i = 0, miss = 0; i < NLOOKUP; i++ )
+            miss += mm_heap_of( ptr[i % NPTR] ) != h;
+        t = now() - t0;
+        printf( "%-14ld %12.2f %12zu %11.3f%%%s\n", gib, t * 1e9 / NLOOKUP, rss >> 10,
+                100.0 * rss / ( (double)gib * ( 1 << 30 ) ), miss ? " (lookups missed)" : "" );
+    }
+    mm_heap_destroy( h );
+    free( blk );
+}
+
+/* the blocks bench_neighbour works on: even ones written, odd ones churned */
+struct neighbours {
+    mm_heap_t *h;
+    char **blk;
+    int nblk;
+    size_t last;            /* index of the last long in a payload */
+    volatile int stop;
+    unsigned long long churns;
+};
+
+/*
+ * churn_odd - Free and allocate the odd blocks over and over until stop
+ */
+static void *churn_odd(void *arg)
+{
+    struct neighbours *nb = arg;
+    int i;
+
+    while( !nb->stop )
+        for( i = 1; i < nb->nblk; i += 2 ) {
+            mm_heap_free( nb->h, nb->blk[i] );
+            nb->blk[i] = mm_heap_malloc( nb->h, 24 );
+            nb->churns++;
+        }
+    return NULL;
+}
+
+/*
+ * bench_neighbour - Lay out NBLK adjacent 24-byte blocks and make n
+ *                   passes writing the first and last usable word of
+ *                   each even one, first alone and then while a second thread
+ *                   frees and reallocates the odd ones. In the normal
+ *                   build every free and malloc of a neighbour writes
+ *                   tags into the cache lines being written; in a
+ *                   -DMM_OOB build the tags live in the shadow instead.
+ */
+static void bench_neighbour(long n)
+{
+    enum { NBLK = 4096 };
+#ifdef MM_OOB
+    static const char *build = "oob";
+#else
+    static const char *build = "inline";
+#endif
+    struct neighbours nb;
+    double val[NCOUNTERS], t0, t;
+    int valid[NCOUNTERS];
+    unsigned long long writes;
+    struct pgroup g;
+    pthread_t tid;
+    long pass;
+    int i, churned;
+
+    memset( &nb, 0, sizeof( nb ) );
+    if( ( nb.h = mm_heap_create_ex( maxheap, MM_HEAP_RESERVE ) ) == NULL ||
+        ( nb.blk = malloc( NBLK * sizeof( *nb.blk ) ) ) == NULL ) {
+        fprintf( stderr, "mmeval: cannot create a heap\n" );
+        exit( 1 );
+    }
+    for( nb.nblk = 0; nb.nblk < NBLK; nb.nblk++ )
+        if( ( nb.blk[nb.nblk] = mm_heap_malloc( nb.h, 24 ) ) == NULL ) {
+            fprintf( stderr, "mmeval: heap full\n" );
+            exit( 1 );
+        }
+    nb.last = mm_usable_size( nb.blk[0] ) / sizeof( long ) - 1;
+
+    printf( "%-20s %10s %12s %12s\n", "neighbour", "ns/write", "L1d/write", "churns" );
+    for( churned = 0; churned < 2; churned++ ) {
+        nb.stop = 0;
+        nb.churns = 0;
+        if( churned && pthread_create( &tid, NULL, churn_odd, &nb ) ) {
+            perror( "pthread_create" );
+            exit( 1 );
+        }
+        group_open( &g );
+        group_read( &g, val, valid );
+        t0 = now();
+        group_on( &g );
+        for( pass = 0; pass < n; pass++ )
+            for( i = 0; i < NBLK; i += 2 ) {
+                ( (volatile long *)nb.blk[i] )[0] = pass;
+                ( (volatile long *)nb.blk[i] )[nb.last] = pass;
+            }
+        group_off( &g );
+        t = now() - t0;
+        group_read( &g, val, valid );
+        group_close( &g );
+        nb.stop = 1;
+        if( churned )
+            pthread_join( tid, NULL );
+        writes = (unsigned long long)n * NBLK;
+        printf( "%-6s %-13s %10.2f", build, churned ? "churned" : "alone", t * 1e9 / writes );
+        if( valid[L1D_COUNTER] )
+            printf( " %12.4f", val[L1D_COUNTER] / writes );
+        else
+            printf( " %12s", "-" );
+        printf( " %12llu\n", nb.churns );
+    }
+    mm_heap_destroy( nb.h );
+    free( nb.blk );
+}
+
+/*
+ * run_workload - Run the workload spec names, "name[,n]"
+ */
+static void run_workload(const char *spec)
+{
+    const char *comma = strchr( spec, ',' );
+    size_t len = comma ? (size_t)( comma - spec ) : strlen( spec );
+    int i;
+
+    for( i = 0; i < NWORKLOADS; i++ )
+        if( strlen( workloads[i].name ) == len && !strncmp( spec, workloads[i].name, len ) ) {
+            workloads[i].run( comma ? atol( comma + 1 ) : workloads[i].n );
+            return;
+        }
+    fprintf( stderr, "workloads, with the default n:\n" );
+    for( i = 0; i < NWORKLOADS; i++ )
+        fprintf( stderr, "  %-12s %-10ld %s\n", workloads[i].name, workloads[i].n, workloads[i].help );
+    exit( strcmp( spec, "help" ) != 0 );
+}
+
+static void usage(const char *prog)
+{
+    fprintf( stderr, "usage: %s [-p] [-t threads] [-m maxheap] [-L ops] [-P ops] [-R base] [-c policy]... tracefile\n"
+                     "       %s [-m maxheap] -w workload[,n]\n", prog, prog );
+    exit( 1 );
+}
+
+int main(int argc, char **argv)
+{
+    static const char *grid[] = {
+        "fit=first", "fit=first,chunk=4096", "fit=first,classes=4", "fit=first,chunk=4096,classes=4",
+        "fit=best", "fit=best,chunk=4096", "fit=best,classes=4", "fit=best,chunk=4096,classes=4",
+    };
+    pthread_t *tid;
+    const char *workload = NULL;
+    int nthreads = sysconf( _SC_NPROCESSORS_ONLN );
+    int c, i;
+
+    while( ( c = getopt( argc, argv, "pt:m:L:P:R:c:w:" ) ) != -1 ) {
+        switch( c ) {
+        case 'w':
+            workload = optarg;
+            break;
+        case 'L':
+            lifetime_split = atol( optarg );
+            break;
+        case 'P':
+            predict = atol( optarg );
+            break;
+        case 'R':
+            fixed_base = (char *)(size_t)strtoull( optarg, NULL, 0 );
+            break;
+        case 'p':
+            perf = 1;
+            break;
+        case 't':
+            nthreads = atoi( optarg );
+            break;
+        case 'm':
+            maxheap = strtoull( optarg, NULL, 0 );
+            break;
+        case 'c':
+            if( npolicies == MAXPOLICIES || parse_policy( &policies[npolicies++], optarg ) < 0 ) {
+                fprintf( stderr, "%s: bad policy '%s'\n", argv[0], optarg );
+                exit( 1 );
+            }
+            break;
+        default:
+            usage( argv[0] );
+        }
+    }
+    if( workload && optind == argc ) {
+        run_workload( workload );
+        return 0;
+    }
+    if( optind != argc - 1 )
+        usage( argv[0] );
+    if( fixed_base && predict ) {
+        fprintf( stderr, "%s: -P needs arenas, which heaps at a fixed base (-R) do not get\n", argv[0] );
+        exit( 1 );
+    }
+    if( !npolicies )
+        for( ; npolicies < (int)( sizeof( grid ) / sizeof( grid[0] ) ); npolicies++ )
+            parse_policy( &policies[npolicies], grid[npolicies] );
+    if( nthreads < 1 )
+        nthreads = 1;
+    if( nthreads > npolicies )
+        nthreads = npolicies;
+    if( fixed_base )
+        for( i = 0; i < npolicies; i++ )
+            policies[i].base = fixed_base + i * ( ( maxheap + ( 1 << 21 ) - 1 ) & ~(size_t)( ( 1 << 21 ) - 1 ) );
+
+    load_trace( argv[optind] );
+
+    tid = malloc( nthreads * sizeof( *tid ) );
+    for( i = 0; i < nthreads; i++ )
+        if( pthread_create( &tid[i], NULL, worker, NULL ) ) {
+            perror( "pthread_create" );
+            exit( 1 );
+        }
+    for( i = 0; i < nthreads; i++ )
+        pthread_join( tid[i], NULL );
+
+    printf( "%-36s %12s %8s %8s %12s%s\n", "policy", "ops/sec", "util", "frag", "peak heap",
+            fixed_base ? "  repro" : "" );
+    for( i = 0; i < npolicies; i++ ) {
+        struct policy *pol = &policies[i];
+        double util, frag;
+
+        if( pol->failed ) {
+            printf( "%-36s %12s\n", pol->name, "failed" );
+            continue;
+        }
+        util = pol->st.peak_heapsize ? (double)pol->peak_payload / pol->st.peak_heapsize : 0;
+        frag = pol->st.free_bytes ? 1 - (double)pol->st.largest_free / pol->st.free_bytes : 0;
+        printf( "%-36s %12.0f %7.1f%% %7.1f%% %12zu", pol->name,
+                pol->secs > 0 ? trace.num_ops / pol->secs : 0,
+                100 * util, 100 * frag, pol->st.peak_heapsize );
+        if( fixed_base )
+            printf( "  %s %016llx", pol->repro ? "same" : "DIFF", pol->digest );
+        printf( "\n" );
+    }
+    if( perf )
+        print_counters();
+    return 0;
+}